@@ -9,6 +9,7 @@
 #include "dbone/columns/column.hpp"
 #include "dbone/insert.hpp"
 #include "dbone/search.hpp"
+#include "dbone/database.hpp"
 #include <memory>
 #include <iostream>
 #include <chrono>
@@ -59,16 +60,16 @@ std::string make_code(size_t id)
 void insert_table(size_t n, uint32_t page_size)
 {
     auto start = std::chrono::high_resolution_clock::now();
+    dbone::Database db = dbone::Database::open(
+        "C:/Users/zakha/Documents/15. Database+/store/table.efdb",
+        page_size);
     for (size_t i = 0; i < n; i++)
     {
         dbone::insert::Row row1 = {
             {"id", std::to_string(i)},
             {"code", make_code(i)}};
 
-        auto result = dbone::insert::insert(
-            "C:/Users/zakha/Documents/15. Database+/store/table.efdb",
-            row1,
-            page_size);
+        auto result = db.insert(row1);
 
         if (!result.ok)
         {
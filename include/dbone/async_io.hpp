@@ -0,0 +1,81 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include "dbone/storage.hpp"
+
+namespace dbone::storage {
+
+// Batched positional reads on one PageFile.
+//
+// read_batch() puts every request of a batch in flight at once and returns
+// when all of them have completed, so the scattered extents of a node or
+// the children of an inner node cost one round of device latency instead
+// of one each. On Linux the batch is submitted to an io_uring with a
+// single io_uring_enter; where that is unavailable (old kernel, seccomp,
+// other platforms) a small pool of threads issues the preads in parallel.
+//
+// Any number of threads may call read_batch() at once. The ring serves
+// one batch at a time; a batch that finds it busy is read with preads on
+// the calling thread instead of waiting. Pool workers take requests from
+// every queued batch, oldest first.
+class AsyncReader
+{
+public:
+    struct Request
+    {
+        uint64_t offset = 0;
+        uint8_t *dst = nullptr;
+        size_t len = 0;
+        bool ok = false; // set once the request has been read in full
+    };
+
+    // threads: fallback readers; 0 reads the batch on the calling thread.
+    AsyncReader(PageFile &file, unsigned threads, bool use_io_uring = true);
+    ~AsyncReader();
+
+    AsyncReader(const AsyncReader &) = delete;
+    AsyncReader &operator=(const AsyncReader &) = delete;
+
+    // True if every request was read in full.
+    bool read_batch(std::span<Request> requests);
+
+    bool uses_io_uring() const;
+
+private:
+    struct Ring;
+
+    struct Batch
+    {
+        std::span<Request> requests;
+        size_t next = 0;      // next request to hand out
+        size_t remaining = 0; // requests not yet finished
+    };
+
+    bool ring_batch(std::span<Request> requests);
+    bool pool_batch(std::span<Request> requests);
+    void worker();
+    void run(Request &request);
+
+    // Caller holds mu_. Next request of batch; the batch leaves queue_
+    // once all of its requests are handed out.
+    Request &take(Batch &batch);
+
+    PageFile &file_;
+    mutable std::mutex ring_mu_; // held by the batch using the ring
+    std::unique_ptr<Ring> ring_;
+
+    std::mutex mu_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::vector<Batch *> queue_; // batches with requests not yet handed out
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+} // namespace dbone::storage
@@ -1,11 +0,0 @@
-#include <vector>
-#include <string>
-
-struct available_pages
-{
-    std::vector<uint32_t> read_from_page_pointers; // ordered including page 0
-    std::vector<uint32_t> available_pages_pointers;
-};
-
-available_pages get_available_pages(const std::string &file_name, uint32_t available_pages_ref, uint32_t page_size = 4096);
-bool set_available_pages_db(const std::string &file_name, const available_pages &available_pages_info, uint32_t page_size);
\ No newline at end of file
@@ -0,0 +1,377 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "dbone/storage.hpp"
+#include "dbone/async_io.hpp"
+#include "dbone/wal.hpp"
+#include "dbone/free_space_map.hpp"
+
+namespace dbone::storage {
+
+// How a BufferPool reads pages.
+//   Buffered - pread into cache frames (default).
+//   Mapped   - PageRefs point straight into a read-only mmap of the file;
+//              no frames, no copies. Writes still go through pwrite.
+//              Falls back to Buffered where mmap is unavailable.
+//   Direct   - like Buffered, but the file is opened O_DIRECT so the OS
+//              page cache is bypassed: the pool is the only cache, memory
+//              use is capacity_bytes, and pages are not copied twice.
+//              Needs a page size that is a multiple of
+//              AlignedBuffer::ALIGNMENT; falls back to Buffered otherwise
+//              or where the filesystem refuses O_DIRECT.
+enum class IoMode
+{
+    Buffered,
+    Mapped,
+    Direct
+};
+
+// Fixed-capacity page cache for one table file.
+//
+// Every node load/save goes through here, so hot pages (root and inner
+// nodes) are served from memory instead of a fresh open + seek + read.
+// Frames are recycled with the CLOCK algorithm; a frame is never evicted
+// while a PageRef to it is alive. Writes are write-through: the page is
+// written to the file and the cached copy updated in the same call.
+// Readers parse pinned frames in place, so a frame is never written while
+// pinned: the new image goes to a fresh frame and the old one is reused
+// once its last PageRef is gone.
+//
+// With Options::wal, writes inside a Transaction go to frames only that
+// transaction sees; other readers keep the committed pages. commit() logs the images of every page the transaction wrote to
+// the WriteAheadLog, waits for the (group) fsync, and only then writes the
+// pages to the table file, so a crash mid-split can no longer leave a torn
+// tree. Frames newer than the table file are never evicted. A log left
+// behind by a crash is replayed when the pool is opened, WAL or not.
+class BufferPool
+{
+public:
+    struct Options
+    {
+        size_t capacity_bytes = 64ull * 1024 * 1024;
+        IoMode io_mode = IoMode::Buffered;
+        bool wal = false;
+        // Truncate the log once it has grown past this and every logged
+        // page has been written back.
+        uint64_t wal_checkpoint_bytes = 16ull * 1024 * 1024;
+        // Disk space is reserved ahead of the end of the table, doubling
+        // up to chunks of this size (0 = grow page by page on write).
+        uint64_t grow_chunk_bytes = 8ull * 1024 * 1024;
+        // Batched reads (read_pages, prefetch) go through io_uring where
+        // available, else through this many reader threads.
+        bool io_uring = true;
+        unsigned io_threads = 4;
+    };
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t remaps = 0;
+        uint64_t read_calls = 0;  // reads issued on misses
+        uint64_t read_batches = 0; // batches submitted through the AsyncReader
+        uint64_t prefetched = 0;   // pages loaded by prefetch()
+        uint64_t write_calls = 0; // write_page/write_pages syscall batches
+        uint64_t commits = 0;     // logged transactions
+        uint64_t log_flushes = 0; // fdatasyncs of the log; < commits under group commit
+        uint64_t checkpoints = 0;
+        uint64_t recovered = 0; // transactions replayed from the log on open
+        uint64_t reservations = 0; // grow_chunk_bytes chunks reserved on disk
+    };
+
+    // Pinned view of a cached page. Unpins on destruction.
+    class PageRef
+    {
+    public:
+        PageRef() = default;
+        ~PageRef() { reset(); }
+
+        PageRef(const PageRef &) = delete;
+        PageRef &operator=(const PageRef &) = delete;
+        PageRef(PageRef &&other) noexcept;
+        PageRef &operator=(PageRef &&other) noexcept;
+
+        const uint8_t *data() const { return data_; }
+        uint32_t page_id() const { return page_id_; }
+        explicit operator bool() const { return pool_ != nullptr; }
+
+        void reset();
+
+    private:
+        friend class BufferPool;
+        PageRef(BufferPool *pool, size_t frame, uint32_t page_id, const uint8_t *data)
+            : pool_(pool), frame_(frame), page_id_(page_id), data_(data) {}
+        PageRef(BufferPool *pool, std::shared_ptr<MappedRegion> mapping, uint32_t page_id, const uint8_t *data)
+            : pool_(pool), frame_(NO_FRAME), page_id_(page_id), data_(data), mapping_(std::move(mapping)) {}
+
+        static constexpr size_t NO_FRAME = SIZE_MAX;
+
+        BufferPool *pool_ = nullptr;
+        size_t frame_ = 0;
+        uint32_t page_id_ = 0;
+        const uint8_t *data_ = nullptr;
+        std::shared_ptr<MappedRegion> mapping_; // keeps an old mapping alive across remaps
+    };
+
+    // Groups the page writes of one logical change (an insert and every
+    // split it causes). Only one transaction is open per pool at a time;
+    // begin() waits for the previous one to commit or abort. Destroying an
+    // uncommitted transaction aborts it: with a WAL its writes are dropped,
+    // without one they are already on disk and stay there.
+    class Transaction
+    {
+    public:
+        Transaction() = default;
+        ~Transaction();
+
+        Transaction(const Transaction &) = delete;
+        Transaction &operator=(const Transaction &) = delete;
+        Transaction(Transaction &&other) noexcept;
+        Transaction &operator=(Transaction &&other) noexcept;
+
+        // Returns once the transaction is durable. The next transaction may
+        // start while this one is still waiting on the log.
+        void commit();
+
+        // Commit what was written so far and carry on in a new transaction
+        // without letting another writer in between, so a change too big
+        // for one transaction still keeps the table to itself.
+        void commit_and_continue();
+
+    private:
+        friend class BufferPool;
+        Transaction(BufferPool *pool, std::unique_lock<std::mutex> writer)
+            : pool_(pool), writer_(std::move(writer)) {}
+
+        BufferPool *pool_ = nullptr;
+        std::unique_lock<std::mutex> writer_;
+    };
+
+    BufferPool(const std::string &path, uint32_t page_size, const Options &options);
+    ~BufferPool();
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    // Pin a page, reading it from disk on a miss.
+    PageRef fetch(uint32_t page_id);
+
+    // Copy a page into dst (page_size bytes).
+    void read_page(uint32_t page_id, uint8_t *dst);
+
+    // Copy page_ids.size() pages into dst (page i at dst + i * page_size).
+    // Cached pages are copied from memory. Each run of adjacent uncached
+    // ids becomes one read, and all of them are submitted as one batch, so
+    // a node costs one round trip however many extents it spans.
+    void read_pages(std::span<const uint32_t> page_ids, uint8_t *dst);
+
+    // Load pages the caller is about to fetch (e.g. the children a scan
+    // will descend into) in one batch, so later fetches hit the cache
+    // instead of each waiting for its own read. Best effort: pages that
+    // are cached, missing from the file or don't fit are skipped. No-op in
+    // Mapped mode.
+    void prefetch(std::span<const uint32_t> page_ids);
+
+    // Write a page through to disk and refresh the cached copy.
+    void write_page(uint32_t page_id, const uint8_t *src);
+
+    // Write page_ids.size() pages from src (page i at src + i * page_size).
+    // Pages are written in id order and runs of adjacent ids go out as one
+    // vectored write, so a node spread over consecutive pages costs one
+    // syscall instead of one per page.
+    void write_pages(std::span<const uint32_t> page_ids, const uint8_t *src);
+
+    Transaction begin();
+
+    // Free-space map rooted at root_page (TableSchema::available_pages_ref),
+    // loaded on first use. Its changes are written when a transaction
+    // commits, so they are logged together with the pages they describe.
+    FreeSpaceMap &free_space(uint32_t root_page);
+    // Whether page is free in the loaded free-space map, or nullopt while
+    // none is loaded. For readers: an aborting transaction can drop the map
+    // free_space() returned, so they must not hold on to it.
+    std::optional<bool> is_free(uint32_t page) const;
+
+    // Pages from the root of the tree at root_page down to its rightmost
+    // leaf, as recorded by the last insert that ended there; empty when
+    // unknown. Lets inserts of ever-growing keys append without a descent.
+    // Forgotten when a transaction aborts and on invalidate(), and must be
+    // cleared by anything else that reshapes the tree.
+    std::vector<uint32_t> right_edge(uint32_t root_page) const;
+    void set_right_edge(uint32_t root_page, std::vector<uint32_t> pages);
+
+    // Drop every unpinned clean frame (e.g. after the file was rewritten
+    // elsewhere).
+    void invalidate();
+
+    // Hand out n new pages at the end of the table and return the first.
+    // The end is tracked in memory, so no stat per allocation; disk space
+    // behind it is reserved a chunk at a time.
+    uint32_t allocate_pages(uint32_t n);
+
+    // Pages in the table, counting ones handed out or written but not yet
+    // in the file.
+    uint64_t page_count() const;
+
+    uint32_t page_size() const { return page_size_; }
+    size_t capacity_bytes() const { return max_frames_ * page_size_; }
+    IoMode io_mode() const { return io_mode_; }
+    Stats stats() const;
+
+    // Process-wide pool per table file, opened on first use. Options only
+    // apply when the call opens the pool; otherwise the existing one is
+    // returned unchanged. The overload without options uses the defaults
+    // from set_default_options().
+    static std::shared_ptr<BufferPool> shared(const std::string &path, uint32_t page_size);
+    static std::shared_ptr<BufferPool> shared(const std::string &path, uint32_t page_size, const Options &options);
+    static void release(const std::string &path);
+    static void set_default_options(const Options &options);
+
+private:
+    struct Frame
+    {
+        uint32_t page_id = 0;
+        uint32_t pin_count = 0;
+        bool valid = false;
+        bool referenced = false;
+        bool dirty = false; // newer than the table file; not evictable
+        bool loading = false; // being read from disk; wait on load_cv_
+        uint64_t lsn = 0;   // commit LSN of the last write, TXN_LSN while uncommitted
+        AlignedBuffer data;
+    };
+
+    struct PendingPage
+    {
+        uint64_t lsn;
+        std::vector<uint8_t> image;
+    };
+
+    static constexpr uint64_t TXN_LSN = UINT64_MAX;
+
+    // Caller holds mu_. Returns a free or evicted frame, or SIZE_MAX when
+    // every frame is pinned.
+    size_t grab_frame();
+
+    // Caller holds mu_. Put frame in page_table_ as page_id, pinned and
+    // loading, so the read can happen without mu_ and other fetches of the
+    // page wait for it instead of reading it again.
+    void start_load(size_t frame, uint32_t page_id);
+    // Caller holds mu_ and notifies load_cv_. False if the read failed or
+    // a write replaced the page meanwhile; the frame is dropped then. It
+    // stays pinned either way.
+    bool finish_load(size_t frame, uint32_t page_id, bool ok);
+    void unpin(size_t frame);
+
+    // Caller holds mu_. Frame with the copy of page_id this thread should
+    // see (its own transaction's staged write first), or SIZE_MAX.
+    size_t find_frame(uint32_t page_id) const;
+
+    // Caller holds mu_. Take a frame out of use; one that is still pinned
+    // is handed out again by grab_frame after its last unpin. The caller
+    // unlinks it from page_table_ / txn_pages_.
+    void retire_frame(size_t frame);
+
+    // Caller holds mu_. Refresh (or install) the cached copy of a page that
+    // was just written to disk.
+    void cache_written(uint32_t page_id, const uint8_t *src);
+
+    // Caller holds mu_. Unpinned frame of the open transaction for page_id,
+    // even if that takes the pool over capacity because every frame is
+    // pinned or dirty.
+    size_t txn_frame(uint32_t page_id);
+    size_t overflow_frame();
+
+    // Caller holds mu_. Write (page id, data) pairs to the file in id
+    // order, adjacent ids coalesced into one vectored write (one write
+    // through io_buffer_ in Direct mode).
+    void write_runs(std::vector<std::pair<uint32_t, const uint8_t *>> &pages);
+
+    // Caller holds mu_. Stage writes in the open transaction (WAL mode).
+    void stage_pages(std::span<const uint32_t> page_ids, const uint8_t *src);
+
+    void flush_free_space();
+    void start_txn();
+    uint64_t commit_txn(); // returns the commit LSN, 0 if nothing was logged
+    void abort_txn();
+    void write_back();     // write durable pending pages to the table file
+
+    // Caller holds mu_. Makes sure page_id lies inside the mapping,
+    // remapping if the file has grown past it.
+    void ensure_mapped(uint32_t page_id);
+
+    std::string path_;
+    uint32_t page_size_;
+    size_t max_frames_;
+    IoMode io_mode_;
+    PageFile file_;
+
+    AlignedBuffer io_buffer_; // Direct mode: bounce buffer for writes from caller memory
+    std::unique_ptr<AsyncReader> reader_;
+
+    std::shared_ptr<MappedRegion> mapping_;
+    uint64_t mapped_file_size_ = 0; // bytes known to be backed by the file
+
+    std::unique_ptr<WriteAheadLog> wal_;
+    uint64_t checkpoint_bytes_ = 0;
+    std::mutex writer_mu_; // held by the open Transaction
+
+    mutable std::mutex fsm_mu_;
+    std::unique_ptr<FreeSpaceMap> fsm_;
+
+    mutable std::mutex mu_;
+    std::condition_variable load_cv_; // a loading frame was published or dropped
+    std::vector<Frame> frames_;
+    std::unordered_map<uint32_t, size_t> page_table_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> right_edges_; // by tree root page
+    size_t clock_hand_ = 0;
+    Stats stats_;
+
+    bool txn_open_ = false;
+    std::thread::id txn_owner_;
+    // Pages written by the open transaction and the frames holding them;
+    // published into page_table_ on commit, dropped on abort.
+    std::unordered_map<uint32_t, size_t> txn_pages_;
+
+    uint64_t end_page_ = 0;       // high-water mark: one past the last page in use
+    uint64_t txn_end_page_ = 0;   // end_page_ when the open transaction began
+    uint64_t reserved_bytes_ = 0; // file space reserved so far
+    uint64_t grow_chunk_bytes_ = 0;
+    // Committed (logged) pages not yet written to the table file.
+    std::unordered_map<uint32_t, PendingPage> pending_;
+};
+
+// Payload of a page chain, the on-disk layout of index nodes. The root page
+// holds [u32 n][u32 page id x n] and the payload continues through each
+// listed page in order.
+//
+// A single-page chain is read in place from the pinned root page; longer
+// chains are assembled into one buffer with a single read_pages call.
+class PageChain
+{
+public:
+    std::span<const uint8_t> bytes() const;
+    const std::vector<uint32_t> &pages() const { return pages_; }
+
+private:
+    friend PageChain read_page_chain(BufferPool &pool, uint32_t root_page);
+
+    BufferPool::PageRef root_;
+    size_t header_size_ = 0;
+    size_t page_size_ = 0;
+    std::vector<uint32_t> pages_;
+    std::vector<uint8_t> assembled_;
+};
+
+PageChain read_page_chain(BufferPool &pool, uint32_t root_page);
+
+} // namespace dbone::storage
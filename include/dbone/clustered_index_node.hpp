@@ -2,8 +2,12 @@
 #include <vector>
 #include <cstdint>
 #include <optional>
+#include <string>
 #include "row.hpp"
 #include "dbone/bitbuffer.hpp"
+#include "dbone/buffer_pool.hpp"
+
+class ClusteredIndexNodeView;
 
 class ClusteredIndexNode
 {
@@ -14,6 +18,8 @@ public:
                                    uint32_t page_num,
                                    const TableSchema &schema,
                                    uint32_t page_size = 4096);
+    // Decode a node already read through a view, without reading it again
+    static ClusteredIndexNode load(ClusteredIndexNodeView &&view);
 
     // Add a row
     void add_row(DataRow &&row);
@@ -28,7 +34,6 @@ public:
 
     // Add a list of available pages (in order)
     void set_available_pages(const std::vector<uint32_t> &pages);
-    void set_extra_available_pages(const std::vector<uint32_t> &pages);
 
     std::vector<uint32_t> get_available_pages_index();
     std::optional<uint32_t> get_original_page();
@@ -40,23 +45,157 @@ public:
     BitBuffer to_bits() const;
 
     // Save clustered index across pages
-    // Returns list of page IDs used
+    // Returns list of page IDs used. With save = false nothing is written or
+    // allocated, and only the pages taken from the available list are returned
     std::vector<uint32_t> save(const std::string &db_path, const TableSchema &schema, uint32_t page_size = 4096, bool save = true);
 
+    // Persist a node whose only change since load() is the row added at
+    // position (and its pointers). The row goes into free space on one
+    // page and the slot directory on the root page is rewritten; the rest
+    // of the node is left alone. Falls back to save() when there is no room
+    // or the node is not in slotted format.
+    void save_row(const std::string &db_path, const TableSchema &schema, uint32_t page_size, size_t position);
+
+    // Persist a node whose only change since load() is the row at position,
+    // replaced by one with the same primary key. A row that fits where the
+    // old one was is written over it, so only its page and the directory
+    // change; a longer one is placed as save_row() would.
+    void save_replaced(const std::string &db_path, const TableSchema &schema, uint32_t page_size, size_t position);
+
     bool is_leaf() const { return page_pointers_.empty(); }
 
+    // Neighbouring leaves of a B+tree leaf, 0 where there is none. Once
+    // set, the links are kept on disk with the node.
+    void set_leaf_links(uint32_t prev, uint32_t next);
+    uint32_t prev_leaf() const { return prev_leaf_; }
+    uint32_t next_leaf() const { return next_leaf_; }
+
+    // Write the node after only its links changed: the directory on the
+    // first page when the node is slotted, the whole node otherwise.
+    void save_links(const std::string &db_path, const TableSchema &schema, uint32_t page_size);
+
     void print() const;
 
 private:
+    friend class ClusteredIndexNodeView;
+
+    // Slotted node layout. The root page holds the page-chain header, the
+    // node header and a slot directory in key order; rows are packed
+    // downwards from the end of each page of the node:
+    //   root:  [u32 n][u32 page ids...][u32 magic][u16 nRows][u16 flags][u32 ptr0]
+    //          ([u32 prev][u32 next] if FLAG_LINKED)
+    //          ([u16 length][key prefix] if FLAG_PREFIX)
+    //          [u32 ptr][u16 page][u16 offset][u16 length][u16 key] * nRows
+    //          ... free ... rows
+    //   other: ... free ... rows
+    // Nodes that cannot be laid out this way (rows wider than a page, pages
+    // over 64 KiB, a directory that does not fit the root) use the stream
+    // format instead: [u32 n][u32 page ids...][u32 nRows][u32 ptr0]
+    // ([row][u32 ptr]) * nRows, spilling across the pages.
+    // When the CHAR or VARCHAR primary keys of a slotted node share a
+    // prefix, it is stored once in the header and each row holds only the
+    // rest of its key.
+    struct Slot
+    {
+        uint16_t page;   // index into the node's pages, 0 = root
+        uint16_t offset; // byte offset within that page
+        uint16_t length;
+        uint16_t key;    // primary key value (or its suffix), in bytes from the row start
+    };
+
+    static constexpr uint32_t SLOTTED_MAGIC = 0x31544C53; // "SLT1"; never a stream-format row count
+    static constexpr uint32_t LINKED_MAGIC = 0x314B4E4C;  // "LNK1"; stream format with leaf links
+    static constexpr size_t NODE_HEADER_SIZE = 12;
+    static constexpr size_t LINKS_SIZE = 8;      // [u32 prev][u32 next] after the header
+    static constexpr uint16_t FLAG_LINKED = 1;
+    static constexpr uint16_t FLAG_PREFIX = 2;
+    static constexpr size_t SLOT_SIZE = 12;
+    static constexpr uint16_t NO_KEY = 0xFFFF;
+
+    static uint16_t slot_key(size_t key_offset);
+    static bool plan_slots(const std::vector<size_t> &lengths, uint32_t page_size, size_t max_rows,
+                           size_t node_header, std::vector<Slot> &slots, size_t &num_pages);
+    size_t node_header_size(const std::string &key_prefix) const
+    {
+        return NODE_HEADER_SIZE + (linked_ ? LINKS_SIZE : 0) + (key_prefix.empty() ? 0 : 2 + key_prefix.size());
+    }
+    // Longest prefix shared by the primary keys of at least two rows, when
+    // they are CHAR or VARCHAR
+    std::string common_key_prefix() const;
+    void write_directory(uint8_t *root, const std::vector<uint32_t> &pages) const;
+
     uint32_t min_length_ = 0;
     std::vector<DataRow> items_;
     std::vector<uint32_t> page_pointers_; // child references
 
     std::optional<uint32_t> original_page_; // first page
     std::vector<uint32_t> available_pages_; // pool of extra pages
-    std::vector<uint32_t> extra_available_pages_;
+
+    bool slotted_ = false;    // loaded from / last saved in slotted format
+    std::vector<Slot> slots_; // where each row lives on disk, while slotted_
+
+    bool linked_ = false; // B+tree leaf, with links on disk
+    uint32_t prev_leaf_ = 0;
+    uint32_t next_leaf_ = 0;
+
+    std::string key_prefix_; // left out of every key on disk, while slotted_
 
     uint32_t next_new_page_id_ = 0; // for allocating new pages
 };
 
-size_t num_pages_in_file(const std::string &path, size_t page_size);
\ No newline at end of file
+// Read-only access to a stored node without decoding it. Keys are compared
+// straight from the page bytes through the slot directory, so a lookup
+// costs O(log rows) comparisons and decodes only the row it returns.
+// Stream-format nodes have no directory and are decoded in full instead.
+class ClusteredIndexNodeView
+{
+public:
+    static ClusteredIndexNodeView load(const std::string &db_path,
+                                       uint32_t page_num,
+                                       const TableSchema &schema,
+                                       uint32_t page_size = 4096);
+    // Whether page_num looks like the first page of a slotted node, judged
+    // from that page alone. For page numbers kept outside the tree (index
+    // locators), whose page may have been freed or reused since.
+    static bool is_node(dbone::storage::BufferPool &pool, uint32_t page_num);
+
+    uint32_t page() const { return page_num_; }
+    size_t size() const { return rows_.size(); }
+    // Child left of row i; i == size() is the rightmost child. 0 in leaves
+    uint32_t pointer(size_t i) const { return pointers_[i]; }
+    uint32_t prev_leaf() const { return prev_leaf_; }
+    uint32_t next_leaf() const { return next_leaf_; }
+
+    // <0, 0 or >0 as the primary key of row i sorts before, equal to or
+    // after key
+    int compare_key(size_t i, const DataType &key) const;
+    // First row whose primary key is not less than key, size() if none
+    size_t lower_bound(const DataType &key) const;
+
+    DataRow row(size_t i) const;
+
+private:
+    friend class ClusteredIndexNode;
+
+    const TableSchema *schema_ = nullptr;
+    uint32_t page_num_ = 0;
+    size_t key_column_ = 0;
+    dbone::storage::PageChain chain_;
+    std::vector<uint32_t> pointers_;
+    std::vector<size_t> rows_; // payload offset of each row
+    std::vector<size_t> keys_; // payload offset of each primary key, or DataRow::NO_KEY
+    // The primary keys themselves, in order, when the key column is BIGINT;
+    // lower_bound() searches these with a vector kernel.
+    std::vector<int64_t> int_keys_;
+    bool int_keyed_ = false;
+
+    bool slotted_ = false;
+    std::vector<ClusteredIndexNode::Slot> slots_;
+    std::vector<DataRow> decoded_; // stream format only
+
+    bool linked_ = false;
+    uint32_t prev_leaf_ = 0;
+    uint32_t next_leaf_ = 0;
+
+    std::string key_prefix_; // shared by all primary keys; keys_ point at the rest
+};
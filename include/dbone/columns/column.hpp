@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
 #include <memory>
+#include <span>
+#include <string_view>
 #include "dbone/bitbuffer.hpp"
 #include "dbone/columns/dataTypes.hpp"
 
@@ -19,7 +21,8 @@ public:
            bool primaryKey,
            bool unique,
            bool indexed, //
-           std::unique_ptr<DataType> defaultVal);
+           std::unique_ptr<DataType> defaultVal,
+           bool included = false);
 
     virtual ~Column() = default;
 
@@ -29,6 +32,7 @@ public:
           primaryKey_(other.primaryKey_),
           unique_(other.unique_),
           indexed_(other.indexed_),
+          included_(other.included_),
           defaultVal_(other.defaultVal_ ? other.defaultVal_->clone() : nullptr) {}
 
     // --- Copy assignment (deep copy) ---
@@ -41,6 +45,7 @@ public:
             primaryKey_ = other.primaryKey_;
             unique_ = other.unique_;
             indexed_ = other.indexed_;
+            included_ = other.included_;
             defaultVal_ = other.defaultVal_ ? other.defaultVal_->clone() : nullptr;
         }
         return *this;
@@ -55,7 +60,23 @@ public:
     virtual std::unique_ptr<DataType> parse(const std::string &raw) const = 0;
 
     // --- Deserialize from buffer into a DataType instance ---
-    virtual std::unique_ptr<DataType> from_bits(const std::vector<uint8_t> &payload, size_t &ref) const = 0;
+    virtual std::unique_ptr<DataType> from_bits(std::span<const uint8_t> payload, size_t &ref) const = 0;
+
+    // --- Compare a serialized value with value: <0, 0 or >0 as the stored
+    //     value sorts before, equal to or after it. The typed columns read
+    //     the bytes in place; the default decodes through from_bits ---
+    virtual int compare_bits(std::span<const uint8_t> payload, size_t ref, const DataType &value) const;
+
+    // --- Key prefix compression (CHAR and VARCHAR): a node stores the
+    //     prefix its keys share once and each key without it ---
+    // The characters of a CHAR or VARCHAR value, nullptr for other types
+    static const std::string *key_chars(const DataType &value);
+    // value without its first prefix_len characters, encoded like value
+    static void suffix_to_bits(BitBuffer &buf, const DataType &value, size_t prefix_len);
+    // The characters of a suffix written for this column, read in place
+    virtual std::string_view read_suffix(std::span<const uint8_t> payload, size_t &ref, size_t prefix_len) const;
+    // prefix followed by the suffix at ref, as a value of this column
+    virtual std::unique_ptr<DataType> from_suffix_bits(std::span<const uint8_t> payload, size_t &ref, std::string_view prefix) const;
 
     // --- Accessors ---
     virtual ColumnType type() const = 0;
@@ -71,6 +92,9 @@ public:
     bool primaryKey() const { return primaryKey_; }
     bool unique() const { return unique_; }
     bool indexed() const { return indexed_; }
+    // Carried in the postings of the table's secondary indexes, so a query
+    // through one of them can return this column without the row
+    bool included() const { return included_; }
 
 protected:
     std::string name_;
@@ -78,6 +102,7 @@ protected:
     bool primaryKey_;
     bool unique_;
     bool indexed_;
+    bool included_;
     std::unique_ptr<DataType> defaultVal_;
 };
 
@@ -90,11 +115,13 @@ public:
                  bool primaryKey,
                  bool unique,
                  bool indexed,
-                 int64_t defaultVal);
+                 int64_t defaultVal,
+                 bool included = false);
 
     void to_bits(BitBuffer &buf) const override;
     std::unique_ptr<DataType> parse(const std::string &raw) const override;
-    std::unique_ptr<DataType> from_bits(const std::vector<uint8_t> &payload, size_t &ref) const override;
+    std::unique_ptr<DataType> from_bits(std::span<const uint8_t> payload, size_t &ref) const override;
+    int compare_bits(std::span<const uint8_t> payload, size_t ref, const DataType &value) const override;
 
     std::unique_ptr<Column> clone() const override
     {
@@ -114,11 +141,15 @@ public:
                bool primaryKey,
                bool unique,
                bool indexed,
-               std::string defaultVal);
+               std::string defaultVal,
+               bool included = false);
 
     void to_bits(BitBuffer &buf) const override;
     std::unique_ptr<DataType> parse(const std::string &raw) const override;
-    std::unique_ptr<DataType> from_bits(const std::vector<uint8_t> &payload, size_t &ref) const override;
+    std::unique_ptr<DataType> from_bits(std::span<const uint8_t> payload, size_t &ref) const override;
+    int compare_bits(std::span<const uint8_t> payload, size_t ref, const DataType &value) const override;
+    std::string_view read_suffix(std::span<const uint8_t> payload, size_t &ref, size_t prefix_len) const override;
+    std::unique_ptr<DataType> from_suffix_bits(std::span<const uint8_t> payload, size_t &ref, std::string_view prefix) const override;
 
     std::unique_ptr<Column> clone() const override
     {
@@ -141,11 +172,15 @@ public:
                bool primaryKey,
                bool unique,
                bool indexed,
-               std::string defaultVal);
+               std::string defaultVal,
+               bool included = false);
 
     void to_bits(BitBuffer &buf) const override;
     std::unique_ptr<DataType> parse(const std::string &raw) const override;
-    std::unique_ptr<DataType> from_bits(const std::vector<uint8_t> &payload, size_t &ref) const override;
+    std::unique_ptr<DataType> from_bits(std::span<const uint8_t> payload, size_t &ref) const override;
+    int compare_bits(std::span<const uint8_t> payload, size_t ref, const DataType &value) const override;
+    std::string_view read_suffix(std::span<const uint8_t> payload, size_t &ref, size_t prefix_len) const override;
+    std::unique_ptr<DataType> from_suffix_bits(std::span<const uint8_t> payload, size_t &ref, std::string_view prefix) const override;
 
     std::unique_ptr<Column> clone() const override
     {
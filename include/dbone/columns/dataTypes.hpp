@@ -2,6 +2,7 @@
 #include <string>
 #include <cstdint>
 #include <memory>
+#include <span>
 #include "dbone/bitbuffer.hpp"
 #include <ostream>
 
@@ -38,7 +39,7 @@ public:
     explicit BigIntType(int64_t v);
 
     void to_bits(BitBuffer &buf) const override;
-    static BigIntType from_bits(const std::vector<uint8_t> &payload, size_t& ref);
+    static BigIntType from_bits(std::span<const uint8_t> payload, size_t& ref);
 
     std::string default_value_str() const override;
     static std::unique_ptr<BigIntType> parse(const std::string &s);
@@ -67,12 +68,13 @@ public:
     CharType(std::string v, uint32_t length);
 
     void to_bits(BitBuffer &buf) const override;
-    static CharType from_bits(const std::vector<uint8_t> &payload, size_t& ref, uint32_t length);
+    static CharType from_bits(std::span<const uint8_t> payload, size_t& ref, uint32_t length);
 
     std::string default_value_str() const override;
     static std::unique_ptr<CharType> parse(const std::string &s, uint32_t length);
 
     const std::string& value() const { return value_; }
+    uint32_t length() const { return length_; }
 
     // Implement virtual comparison
     bool equals(const DataType& other) const override;
@@ -97,12 +99,13 @@ public:
     VarCharType(std::string v, uint32_t max_length);
 
     void to_bits(BitBuffer &buf) const override;
-    static VarCharType from_bits(const std::vector<uint8_t> &payload, size_t& ref, uint32_t max_length);
+    static VarCharType from_bits(std::span<const uint8_t> payload, size_t& ref, uint32_t max_length);
 
     std::string default_value_str() const override;
     static std::unique_ptr<VarCharType> parse(const std::string &s, uint32_t max_length);
 
     const std::string& value() const { return value_; }
+    uint32_t max_length() const { return max_length_; }
 
     // Implement virtual comparison
     bool equals(const DataType& other) const override;
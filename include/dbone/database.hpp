@@ -0,0 +1,63 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "dbone/schema.hpp"
+#include "dbone/insert.hpp"
+#include "dbone/search.hpp"
+#include "dbone/remove.hpp"
+#include "dbone/buffer_pool.hpp"
+
+namespace dbone {
+
+// An opened table file.
+//
+// The free functions in dbone::insert / dbone::search re-parse the schema
+// pages on every call. A Database parses them once in open() and holds the
+// table's buffer pool (and with it the open file descriptor) for as long as
+// the handle lives, so insert loops only pay for the B-tree work.
+class Database
+{
+public:
+    // options only take effect if this opens the table's pool; see
+    // BufferPool::shared().
+    static Database open(const std::string &db_path, uint32_t page_size = 4096,
+                         const storage::BufferPool::Options &options = {});
+
+    Database(const Database &) = delete;
+    Database &operator=(const Database &) = delete;
+    Database(Database &&) noexcept = default;
+    Database &operator=(Database &&) noexcept = default;
+
+    insert::ValidationResult insert(const insert::Row &row);
+    // See insert::bulk_load
+    insert::ValidationResult bulk_load(const insert::RowSource &rows, double fill_factor = 1.0);
+    // See insert::insert_batch
+    insert::ValidationResult insert_batch(std::span<const insert::Row> rows);
+    // See insert::update
+    insert::UpdateResult update(const DataType &primaryKey, const insert::Row &changes);
+    // See insert::upsert
+    insert::UpdateResult upsert(const insert::Row &row);
+    // See remove::remove
+    remove::RemoveResult remove(const std::vector<std::unique_ptr<DataType>> &primaryKeys);
+
+    SearchResult searchItem(const std::vector<SearchParam> &queries);
+    // See search::searchItem
+    SearchResult searchItem(const std::vector<SearchParam> &queries, const std::vector<std::string> &columns);
+    SearchResult searchPrimaryKeys(std::vector<std::unique_ptr<DataType>> &primaryKeys);
+
+    const TableSchema &schema() const { return schema_; }
+    const std::string &path() const { return path_; }
+    uint32_t page_size() const { return page_size_; }
+    storage::BufferPool &pool() { return *pool_; }
+
+private:
+    Database() = default;
+
+    std::string path_;
+    uint32_t page_size_ = 4096;
+    TableSchema schema_;
+    std::shared_ptr<storage::BufferPool> pool_;
+};
+
+} // namespace dbone
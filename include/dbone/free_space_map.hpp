@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace dbone::storage {
+
+class BufferPool;
+
+// Free-page bitmap for one table file, one bit per page (1 = free).
+//
+// On disk the root page (TableSchema::available_pages_ref) is
+// [u32 n][u32 bitmap page id x n]; bitmap page k holds the bits for pages
+// [k * page_size * 8, (k + 1) * page_size * 8). A zeroed root is an empty
+// map, which is what create_table leaves behind.
+//
+// The whole bitmap is kept in memory. allocate() resumes from a cursor
+// below which no page is free, so allocation is O(1) amortized; when
+// nothing is free it takes new pages from BufferPool::allocate_pages.
+// Changes are written back by flush(), which the buffer pool calls when a
+// transaction commits.
+//
+// Multi-page nodes are kept in extents of adjacent pages (extend_chain) so
+// that the buffer pool can read them with one sequential read.
+class FreeSpaceMap
+{
+public:
+    FreeSpaceMap(BufferPool &pool, uint32_t root_page);
+
+    FreeSpaceMap(const FreeSpaceMap &) = delete;
+    FreeSpaceMap &operator=(const FreeSpaceMap &) = delete;
+
+    uint32_t allocate();
+
+    // First page of n physically contiguous pages.
+    uint32_t allocate_run(uint32_t n);
+
+    // Take this particular page if it is free or past the end of the table.
+    bool allocate_at(uint32_t page);
+
+    // Append pages to a node's page list until it holds n. The last extent
+    // is grown in place while the following page is free; whatever is
+    // still missing comes from one contiguous run, so a node occupies as
+    // few extents as possible and loads with as few reads.
+    void extend_chain(std::vector<uint32_t> &pages, size_t n);
+
+    void free_page(uint32_t page);
+
+    bool is_free(uint32_t page) const;
+    uint64_t free_count() const;
+
+    // Write dirty bitmap pages and the root.
+    void flush();
+
+private:
+    // Callers hold mu_.
+    uint32_t allocate_locked();
+    uint32_t allocate_run_locked(uint32_t n);
+    bool allocate_at_locked(uint32_t page);
+    void mark_used(uint64_t first, uint32_t n);
+    void mark_free(uint32_t page);
+    void mark_dirty(size_t word);
+
+    BufferPool &pool_;
+    uint32_t root_page_;
+    size_t words_per_page_;
+
+    mutable std::mutex mu_;
+    std::vector<uint32_t> bitmap_pages_;
+    std::vector<uint64_t> words_; // bit b of words_[w] is page w * 64 + b
+    std::vector<bool> dirty_;     // per bitmap page
+    bool root_dirty_ = false;
+    uint64_t free_count_ = 0;
+    size_t hint_ = 0;  // no free page below words_[hint_]
+};
+
+} // namespace dbone::storage
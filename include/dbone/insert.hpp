@@ -1,5 +1,7 @@
 #pragma once
 #include "dbone/schema.hpp"
+#include <functional>
+#include <span>
 #include <string>
 #include <unordered_map>
 
@@ -20,4 +22,59 @@ ValidationResult validate_row(const TableSchema& schema, const Row& row);
 /// - Calls validate_row
 ValidationResult insert(const std::string& db_path, const Row& row, uint32_t page_size);
 
+/// Insert against an already-parsed schema (skips read_schema).
+ValidationResult insert(const std::string& db_path, const TableSchema& schema, const Row& row, uint32_t page_size);
+
+/// Fills row with the next row for bulk_load; returns false when done.
+using RowSource = std::function<bool(Row& row)>;
+
+/// Bulk load into an empty table:
+/// - Rows must come sorted by primary key, ascending
+/// - Builds the clustered index and every secondary index bottom-up, each
+///   node filled to fill_factor (0, 1] of its capacity, pages written in order
+/// - The finished roots are written to the table's existing root pages
+/// - Other writers wait until it is done
+/// On failure the table is left empty and the pages the load took are free again.
+ValidationResult bulk_load(const std::string& db_path, const TableSchema& schema, const RowSource& rows, double fill_factor, uint32_t page_size);
+
+/// bulk_load wrapper that loads the schema from path.
+ValidationResult bulk_load(const std::string& db_path, const RowSource& rows, double fill_factor, uint32_t page_size);
+
+/// Insert many rows at once:
+/// - Validates every row, then sorts them by primary key
+/// - Merges them into the clustered index and each secondary index in one
+///   ordered pass per tree; every node touched is read once and written once
+/// - Fails without writing anything if a key repeats in the batch or is
+///   already in the table
+ValidationResult insert_batch(const std::string& db_path, const TableSchema& schema, std::span<const Row> rows, uint32_t page_size);
+
+/// insert_batch wrapper that loads the schema from path.
+ValidationResult insert_batch(const std::string& db_path, std::span<const Row> rows, uint32_t page_size);
+
+struct UpdateResult {
+    bool ok;
+    std::string error;
+    bool found = false; // a row with the key was already in the table
+};
+
+/// Change some columns of the row with the given primary key:
+/// - changes maps column names to new values; the primary key can't change
+/// - The row is rewritten in the node that holds it, found in one descent
+/// - A secondary index is touched only when its column's value changes
+/// - ok with found == false, and nothing written, if no row has the key
+UpdateResult update(const std::string& db_path, const TableSchema& schema, const DataType& primaryKey, const Row& changes, uint32_t page_size);
+
+/// update wrapper that loads the schema from path.
+UpdateResult update(const std::string& db_path, const DataType& primaryKey, const Row& changes, uint32_t page_size);
+
+/// Insert row, or replace the row with its primary key if there is one:
+/// - Same validation as insert
+/// - One descent of the clustered index does either, splitting full nodes
+///   on the way down as insert does
+/// - On replace, secondary indexes are touched only for changed values
+UpdateResult upsert(const std::string& db_path, const TableSchema& schema, const Row& row, uint32_t page_size);
+
+/// upsert wrapper that loads the schema from path.
+UpdateResult upsert(const std::string& db_path, const Row& row, uint32_t page_size);
+
 } // namespace dbone::insert
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+#include "dbone/columns/dataTypes.hpp"
+
+namespace dbone {
+
+// Binary search over the sorted keys of a node. key_at(i) returns the i-th
+// key as a const DataType&; all keys of a node share one column type.
+//
+// The type is resolved once per search: when the keys and the probe are
+// both BIGINT, CHAR or VARCHAR the comparisons read the values directly,
+// instead of a virtual less() with a dynamic_cast per step. Anything else
+// (including mismatched types, which throw as before) goes through the
+// DataType operators.
+
+namespace detail {
+
+template <typename Less>
+size_t partition_point(size_t n, Less less)
+{
+    size_t lo = 0;
+    while (n > 0)
+    {
+        size_t half = n / 2;
+        if (less(lo + half))
+        {
+            lo += half + 1;
+            n -= half + 1;
+        }
+        else
+        {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+// Upper: first key greater than the probe; otherwise first key not less
+template <bool Upper, typename KeyAt>
+size_t bound_key(size_t n, const DataType &key, KeyAt &key_at)
+{
+    if (n == 0)
+        return 0;
+
+    const std::type_info &type = typeid(key);
+    if (typeid(key_at(0)) == type)
+    {
+        if (type == typeid(BigIntType))
+        {
+            int64_t probe = static_cast<const BigIntType &>(key).value();
+            return partition_point(n, [&](size_t i) {
+                int64_t stored = static_cast<const BigIntType &>(key_at(i)).value();
+                return Upper ? stored <= probe : stored < probe;
+            });
+        }
+        if (type == typeid(VarCharType))
+        {
+            const std::string &probe = static_cast<const VarCharType &>(key).value();
+            return partition_point(n, [&](size_t i) {
+                const std::string &stored = static_cast<const VarCharType &>(key_at(i)).value();
+                return Upper ? stored <= probe : stored < probe;
+            });
+        }
+        if (type == typeid(CharType))
+        {
+            const std::string &probe = static_cast<const CharType &>(key).value();
+            return partition_point(n, [&](size_t i) {
+                const std::string &stored = static_cast<const CharType &>(key_at(i)).value();
+                return Upper ? stored <= probe : stored < probe;
+            });
+        }
+    }
+    return partition_point(n, [&](size_t i) { return Upper ? !(key < key_at(i)) : key_at(i) < key; });
+}
+
+} // namespace detail
+
+// First position in keys[0, n) not less than probe; keys must be sorted.
+// Narrows by bisection to a short run and counts the keys below the probe
+// with an AVX2 or SSE4.2 compare-and-count kernel where the CPU has one,
+// a scalar loop otherwise.
+size_t lower_bound_i64(const int64_t *keys, size_t n, int64_t probe);
+
+// First position whose key is not less than key (n if none)
+template <typename KeyAt>
+size_t lower_bound_key(size_t n, const DataType &key, KeyAt key_at)
+{
+    return detail::bound_key<false>(n, key, key_at);
+}
+
+// First position whose key is greater than key (n if none)
+template <typename KeyAt>
+size_t upper_bound_key(size_t n, const DataType &key, KeyAt key_at)
+{
+    return detail::bound_key<true>(n, key, key_at);
+}
+
+} // namespace dbone
@@ -0,0 +1,35 @@
+#pragma once
+#include "dbone/schema.hpp"
+#include "dbone/columns/dataTypes.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dbone::remove {
+
+struct RemoveResult {
+    bool ok;
+    std::string error;
+    size_t removed = 0; // rows found and removed
+};
+
+/// Remove the rows with the given primary keys:
+/// - Each row leaves the clustered index and its entry in every secondary
+///   index; keys not in the table are skipped
+/// - Nodes that fall below schema.min_length items borrow from a sibling
+///   or are merged with it, and pages that empty out go back to the free list
+/// - One transaction for all keys, so with a WAL it is all-or-nothing
+RemoveResult remove(const std::string& db_path, const TableSchema& schema, const std::vector<std::unique_ptr<DataType>>& primaryKeys, uint32_t page_size);
+
+/// remove wrapper that loads the schema from path.
+RemoveResult remove(const std::string& db_path, const std::vector<std::unique_ptr<DataType>>& primaryKeys, uint32_t page_size);
+
+/// Take primaryKey out of the postings of value in the secondary index on
+/// schema.columns[column], for a row whose indexed value goes away:
+/// - The entry leaves the index once no key is left, rebalancing as remove does
+/// - Opens no transaction; runs in the caller's
+/// Returns whether the key was there; throws std::runtime_error when the
+/// table has no primary key.
+bool remove_posting(const std::string& db_path, const TableSchema& schema, size_t column, const DataType& value, const DataType& primaryKey, uint32_t page_size);
+
+} // namespace dbone::remove
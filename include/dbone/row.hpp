@@ -3,6 +3,8 @@
 #include <memory>
 #include <stdexcept>
 #include <optional>
+#include <span>
+#include <string_view>
 #include "dbone/columns/dataTypes.hpp"
 #include "dbone/bitbuffer.hpp"
 #include "dbone/schema.hpp"
@@ -27,10 +29,25 @@ public:
     const DataType &get(size_t col) const;
 
     void to_bits(BitBuffer &buf) const;
+    // Also reports where the primary key value starts, in bytes from the
+    // start of the row (NO_KEY if the row has none)
+    void to_bits(BitBuffer &buf, size_t &key_offset) const;
+    // With the first key_prefix characters of a CHAR or VARCHAR primary key
+    // left out (see Column::suffix_to_bits); read back with the prefix
+    void to_bits(BitBuffer &buf, size_t &key_offset, size_t key_prefix) const;
+    static constexpr size_t NO_KEY = static_cast<size_t>(-1);
     size_t size() const { return values_.size(); }
 
     std::optional<size_t> primaryKeyIndex() const { return primaryKeyIndex_; }
 
+    // A row holding only this row's primary key (B+tree separators)
+    DataRow key_only() const;
+    // The shortest key-only row that sorts after left and not after right,
+    // for a B+tree separator between two leaves: a VARCHAR key is cut just
+    // past the first character where the keys differ, other keys are kept
+    // whole
+    static DataRow separator(const DataRow &left, const DataRow &right);
+
     void print() const;
 
     dbone::insert::Row toRow(const TableSchema& schema)
@@ -49,7 +66,8 @@ public:
 
     // Conversion from Row + Schema
     static DataRow fromRow(const dbone::insert::Row &row, const TableSchema &schema);
-    static DataRow bits_to_row(const std::vector<uint8_t> &payload, size_t &ref, const TableSchema &schema);
+    static DataRow bits_to_row(std::span<const uint8_t> payload, size_t &ref, const TableSchema &schema);
+    static DataRow bits_to_row(std::span<const uint8_t> payload, size_t &ref, const TableSchema &schema, std::string_view key_prefix);
 
 private:
     std::unordered_map<uint16_t, std::unique_ptr<DataType>> values_;
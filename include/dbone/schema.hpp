@@ -22,6 +22,12 @@ struct TableSchema
     std::string table_name;
     std::vector<std::unique_ptr<Column>> columns;
     uint32_t min_length{};
+    // Clustered index as a B+tree: rows only in leaves, which link to their
+    // neighbours; inner nodes hold primary keys only
+    bool bplus_tree{false};
+    // Each secondary index posting also holds the clustered page its row
+    // was written to, so a lookup can read the row without a descent
+    bool index_locators{false};
     std::optional<uint32_t> clustered_page_ref;
     std::optional<uint32_t> available_pages_ref;
     std::unordered_map<size_t, uint32_t> index_page_refs{};
@@ -32,6 +38,8 @@ inline std::ostream &operator<<(std::ostream &os, const TableSchema &schema)
 {
     os << "TableSchema(" << schema.table_name << ")\n";
     os << "  min_length: " << schema.min_length << "\n";
+    os << "  bplus_tree: " << (schema.bplus_tree ? "true" : "false") << "\n";
+    os << "  index_locators: " << (schema.index_locators ? "true" : "false") << "\n";
 
     os << "  clustered_page_ref: ";
     if (schema.clustered_page_ref)
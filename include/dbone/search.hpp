@@ -58,4 +58,19 @@ namespace dbone::search
     
     SearchResult searchPrimaryKeys(const std::string &db_path, std::vector<std::unique_ptr<DataType>> &primaryKeys, uint32_t page_size);
 
+    /// Same as above against an already-parsed schema (skips read_schema).
+    SearchResult searchItem(const std::string &db_path, const TableSchema &schema, const std::vector<SearchParam>& queries, uint32_t page_size);
+
+    /// Only the named columns of each row:
+    /// - A query through a secondary index that holds all of them (the
+    ///   indexed column, the primary key and the columns declared included)
+    ///   is answered from the index alone, without the clustered index
+    /// - Throws if a column is not in the table
+    SearchResult searchItem(const std::string &db_path, const std::vector<SearchParam>& queries, const std::vector<std::string>& columns, uint32_t page_size);
+
+    /// Same as above against an already-parsed schema (skips read_schema).
+    SearchResult searchItem(const std::string &db_path, const TableSchema &schema, const std::vector<SearchParam>& queries, const std::vector<std::string>& columns, uint32_t page_size);
+
+    SearchResult searchPrimaryKeys(const std::string &db_path, const TableSchema &schema, std::vector<std::unique_ptr<DataType>> &primaryKeys, uint32_t page_size);
+
 } // namespace dbone::insert
@@ -1,7 +1,10 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <optional>
 #include <cstdint>
+#include <span>
+#include <string>
 #include "dbone/bitbuffer.hpp"
 #include "dbone/columns/column.hpp"     // Column, ColumnType, DataType
 #include "row.hpp"                      // for TableSchema (you have it there)
@@ -9,6 +12,12 @@
 struct IndexEntry {
     std::unique_ptr<DataType> value;                        // indexed value (e.g., "London")
     std::vector<std::unique_ptr<DataType>> primary_keys;    // postings list of PKs
+    // With TableSchema::index_locators: the clustered page each key's row
+    // was written to, in step with primary_keys; 0 where not known
+    std::vector<uint32_t> locators;
+    // With included columns: for each key, its row's values of
+    // included_columns(), in step with primary_keys
+    std::vector<std::vector<std::unique_ptr<DataType>>> included;
 
     IndexEntry() = default;
     explicit IndexEntry(std::unique_ptr<DataType> v) : value(std::move(v)) {}
@@ -17,6 +26,8 @@ struct IndexEntry {
         value = other.value ? other.value->clone() : nullptr;
         primary_keys.reserve(other.primary_keys.size());
         for (const auto& k : other.primary_keys) primary_keys.push_back(k->clone());
+        locators = other.locators;
+        copy_included(other);
     }
 
     IndexEntry& operator=(const IndexEntry& other) {
@@ -24,13 +35,35 @@ struct IndexEntry {
         value = other.value ? other.value->clone() : nullptr;
         primary_keys.clear(); primary_keys.reserve(other.primary_keys.size());
         for (const auto& k : other.primary_keys) primary_keys.push_back(k->clone());
+        locators = other.locators;
+        copy_included(other);
         return *this;
     }
 
     IndexEntry(IndexEntry&&) noexcept = default;
     IndexEntry& operator=(IndexEntry&&) noexcept = default;
+
+    uint32_t locator(size_t i) const { return i < locators.size() ? locators[i] : 0; }
+
+private:
+    void copy_included(const IndexEntry& other) {
+        included.clear(); included.reserve(other.included.size());
+        for (const auto& values : other.included) {
+            included.emplace_back();
+            for (const auto& v : values) included.back().push_back(v->clone());
+        }
+    }
 };
 
+// Position of the primary-key column in schema.columns, if the table has one
+std::optional<size_t> primary_key_index(const TableSchema& schema);
+// Columns whose values the secondary index on schema.columns[indexed]
+// carries with each key: those declared included, less the primary key and
+// the indexed column, which the posting holds already.
+std::vector<size_t> included_columns(const TableSchema& schema, size_t indexed);
+// row's values of included_columns(schema, indexed)
+std::vector<std::unique_ptr<DataType>> included_values(const TableSchema& schema, size_t indexed, const DataRow& row);
+
 class SecondaryIndexNode {
 public:
     SecondaryIndexNode() = default;
@@ -46,13 +79,17 @@ public:
                                    uint32_t page_size = 4096);
 
     // Save this node (and any overflow pages), returns pages used (root first).
+    // do_save = false is a dry run: nothing is written or allocated and only
+    // pages taken from the available list are returned.
     std::vector<uint32_t> save(const std::string& db_path,
                                const TableSchema& schema,
                                uint32_t page_size = 4096,
                                bool do_save = true) const;
 
     // Serialize whole node payload (not including the multi-page header).
-    BitBuffer to_bits(const Column& indexed_col, const Column& pk_col) const;
+    // With locators, each key is followed by its entry's locator; then by
+    // its included values, if the entry has them.
+    BitBuffer to_bits(const Column& indexed_col, const Column& pk_col, bool locators = false) const;
 
     // Basic accessors/mutators
     std::vector<IndexEntry>&       entries()       { return entries_; }
@@ -74,20 +111,22 @@ public:
     std::optional<uint32_t> original_page() const { return original_page_; }
 
     void set_available_pages(const std::vector<uint32_t>& pages);
-    void set_extra_available_pages(const std::vector<uint32_t>& pages);
 
     // std::vector<IndexEntry> get_entrues() const { return entries_; }
     std::vector<uint32_t> get_available_pages_index() const { return available_pages_; }
 
 private:
-    // disk helpers (same pattern as ClusteredIndexNode)
-    static size_t num_pages_in_file(const std::string& path, size_t page_size);
+    // Prefix compression: when the CHAR/VARCHAR values (or the keys) of a
+    // node share a prefix, the payload starts with PREFIX_MAGIC and both
+    // prefixes, and each value (key) is stored without it
+    static constexpr uint32_t PREFIX_MAGIC = 0x31584650; // "PFX1"; never an entry count
+    std::string common_prefix(bool keys) const;
+    static std::string read_prefix(std::span<const uint8_t> payload, size_t& ref);
+    static void write_prefix(BitBuffer& buf, const std::string& prefix);
 
-private:
     std::vector<IndexEntry> entries_;
     std::vector<uint32_t> page_pointers_;                // size == entries_.size()+1 for internal, ==1 for leaf
     std::optional<uint32_t> original_page_;
     std::vector<uint32_t> available_pages_;
-    std::vector<uint32_t> extra_available_pages_;
     uint32_t next_new_page_id_ = 0;
 };
@@ -2,15 +2,16 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <span>
 #include <stdexcept>
 
-inline uint8_t readU8(const std::vector<uint8_t>& buf, size_t& off) {
+inline uint8_t readU8(std::span<const uint8_t> buf, size_t& off) {
     if (off + 1 > buf.size())
         throw std::runtime_error("readU8: out of bounds at off=" + std::to_string(off));
     return buf[off++];
 }
 
-inline uint16_t readU16(const std::vector<uint8_t>& buf, size_t& off) {
+inline uint16_t readU16(std::span<const uint8_t> buf, size_t& off) {
     if (off + 2 > buf.size())
         throw std::runtime_error("readU16: out of bounds at off=" + std::to_string(off));
     uint16_t v = buf[off] | (buf[off+1] << 8);
@@ -18,7 +19,7 @@ inline uint16_t readU16(const std::vector<uint8_t>& buf, size_t& off) {
     return v;
 }
 
-inline uint32_t readU32(const std::vector<uint8_t>& buf, size_t& off) {
+inline uint32_t readU32(std::span<const uint8_t> buf, size_t& off) {
     if (off + 4 > buf.size())
         throw std::runtime_error("readU32: out of bounds at off=" + std::to_string(off));
     uint32_t v = buf[off] | (buf[off+1] << 8) | (buf[off+2] << 16) | (buf[off+3] << 24);
@@ -26,7 +27,7 @@ inline uint32_t readU32(const std::vector<uint8_t>& buf, size_t& off) {
     return v;
 }
 
-inline int64_t readI64(const std::vector<uint8_t>& buf, size_t& off) {
+inline int64_t readI64(std::span<const uint8_t> buf, size_t& off) {
     if (off + 8 > buf.size())
         throw std::runtime_error("readI64: out of bounds at off=" + std::to_string(off));
 
@@ -43,7 +44,7 @@ inline int64_t readI64(const std::vector<uint8_t>& buf, size_t& off) {
     return static_cast<int64_t>(v);
 }
 
-inline std::string readString(const std::vector<uint8_t>& buf, size_t& off) {
+inline std::string readString(std::span<const uint8_t> buf, size_t& off) {
     uint16_t len = readU16(buf, off);
     if (off + len > buf.size())
         throw std::runtime_error("readString: out of bounds, len=" + std::to_string(len));
@@ -2,6 +2,8 @@
 #include <cstdint>
 #include <cstdio>
 #include <string>
+#include <memory>
+#include <span>
 
 namespace dbone::storage {
 
@@ -14,4 +16,104 @@ bool write_at64(FILE *f, uint64_t offset, const void *data, size_t len);
 // Extend file to exact size (writes trailing zero)
 bool extend_file(FILE *f, uint64_t file_size, std::string *err);
 
+// Zero-filled heap buffer whose start is ALIGNMENT-aligned, as O_DIRECT
+// transfers require.
+class AlignedBuffer
+{
+public:
+    static constexpr size_t ALIGNMENT = 4096;
+
+    AlignedBuffer() = default;
+    explicit AlignedBuffer(size_t size) { resize(size); }
+
+    // Contents are not preserved.
+    void resize(size_t size);
+
+    uint8_t *data() { return data_.get(); }
+    const uint8_t *data() const { return data_.get(); }
+    size_t size() const { return size_; }
+
+private:
+    struct Free
+    {
+        void operator()(uint8_t *p) const;
+    };
+
+    std::unique_ptr<uint8_t, Free> data_;
+    size_t size_ = 0;
+};
+
+// Read-only shared mapping of the first size() bytes of a file. Pages written
+// through the file handle afterwards are visible through the mapping.
+class MappedRegion
+{
+public:
+    MappedRegion(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+    ~MappedRegion();
+
+    MappedRegion(const MappedRegion &) = delete;
+    MappedRegion &operator=(const MappedRegion &) = delete;
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+};
+
+// Random-access handle on a table file. Reads and writes are positional
+// (pread/pwrite), so one open handle can serve every page access.
+class PageFile
+{
+public:
+    PageFile() = default;
+    // create: make the file if it does not exist yet.
+    explicit PageFile(const std::string &path, bool create = false);
+    ~PageFile();
+
+    PageFile(const PageFile &) = delete;
+    PageFile &operator=(const PageFile &) = delete;
+
+    bool is_open() const;
+
+    // Both return false on I/O error or short read/write.
+    bool read_at(uint64_t offset, void *dst, size_t len);
+    bool write_at(uint64_t offset, const void *src, size_t len);
+
+    // Write bufs back to back starting at offset, each len_each bytes, with
+    // as few pwritev calls as possible. Returns false on I/O error.
+    bool write_gather_at(uint64_t offset, std::span<const uint8_t *const> bufs, size_t len_each);
+
+    uint64_t size() const;
+
+    // Flush written data to stable storage (fdatasync).
+    bool sync();
+    bool truncate(uint64_t size);
+
+    // Reserve disk blocks for [offset, offset + len) without changing
+    // size(), so later appends land in space allocated in one piece.
+    // Best effort: a no-op where the platform has no such call.
+    bool reserve(uint64_t offset, uint64_t len);
+
+    // Bypass the OS page cache (O_DIRECT, F_NOCACHE on macOS). While on,
+    // buffers, offsets and lengths must be AlignedBuffer::ALIGNMENT
+    // aligned. Returns false where the platform or filesystem can't.
+    bool set_direct(bool on);
+
+    // Map [0, length) of the file read-only. length may run past EOF so the
+    // mapping can absorb file growth; only bytes below size() may be read.
+    // Returns nullptr where mapping is unsupported (Windows) or fails.
+    std::shared_ptr<MappedRegion> map(uint64_t length) const;
+
+private:
+    friend class AsyncReader; // submits reads on fd_ directly
+
+#if defined(_WIN32)
+    FILE *f_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
 } // namespace dbone::storage
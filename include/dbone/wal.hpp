@@ -0,0 +1,84 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "dbone/storage.hpp"
+
+namespace dbone::storage {
+
+// Redo log of full page images, kept next to the table file (<table>.wal).
+//
+// A transaction is logged as one page-image record per page it wrote,
+// followed by a commit record, all appended in one go. Records carry a
+// checksum, so a torn tail left by a crash is detected and ignored: only
+// transactions whose commit record made it to disk are replayed.
+//
+// Group commit: append() only buffers. flush_to() writes and fdatasyncs
+// everything buffered so far; while one thread is inside the fsync, later
+// committers queue up behind it and the next flush covers all of them, so
+// N concurrent inserts pay for far fewer than N fsyncs.
+class WriteAheadLog
+{
+public:
+    struct PageImage
+    {
+        uint32_t page_id;
+        const uint8_t *data; // page_size bytes
+    };
+
+    struct Stats
+    {
+        uint64_t commits = 0;
+        uint64_t flushes = 0; // fdatasync calls
+        uint64_t bytes = 0;   // bytes written to the log
+    };
+
+    WriteAheadLog(const std::string &path, uint32_t page_size);
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    // Buffer a committed transaction. Returns its commit LSN.
+    uint64_t append(const std::vector<PageImage> &images);
+
+    // Block until every record up to lsn is on stable storage. Throws if
+    // the write or fdatasync fails; the records stay buffered and the next
+    // flush writes them again.
+    void flush_to(uint64_t lsn);
+
+    uint64_t durable_lsn() const;
+    uint64_t file_bytes() const;
+    Stats stats() const;
+
+    // Empty the log once every logged page has reached the (synced) table
+    // file. Returns false, leaving the log alone, if records are still
+    // buffered or being flushed.
+    bool reset();
+
+    // Log file used for the table at table_path.
+    static std::string path_for(const std::string &table_path);
+
+    // Replay committed transactions from the log at log_path into data,
+    // sync data, then empty the log. Returns the number of transactions
+    // replayed (0 if there is no log).
+    static size_t recover(const std::string &log_path, PageFile &data, uint32_t page_size);
+
+private:
+    uint32_t page_size_;
+    PageFile file_;
+
+    mutable std::mutex mu_;
+    std::condition_variable flushed_cv_;
+    std::vector<uint8_t> buffer_; // appended, not yet written
+    uint64_t next_lsn_ = 1;
+    uint64_t appended_lsn_ = 0;
+    uint64_t durable_lsn_ = 0;
+    uint64_t file_bytes_ = 0;
+    bool flushing_ = false;
+    Stats stats_;
+};
+
+} // namespace dbone::storage
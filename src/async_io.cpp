@@ -0,0 +1,337 @@
+#include "dbone/async_io.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define DBONE_HAVE_IO_URING 1
+#endif
+#endif
+
+namespace dbone::storage
+{
+
+#if defined(DBONE_HAVE_IO_URING)
+    // Minimal io_uring: one submission per request, completions reaped by
+    // the submitting thread. No liburing dependency.
+    struct AsyncReader::Ring
+    {
+        static constexpr unsigned ENTRIES = 64;
+
+        int fd = -1;
+        void *sq_ptr = MAP_FAILED;
+        void *cq_ptr = MAP_FAILED;
+        size_t sq_size = 0;
+        size_t cq_size = 0;
+        io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+        size_t sqes_size = 0;
+
+        unsigned *sq_head = nullptr;
+        unsigned *sq_tail = nullptr;
+        unsigned *sq_mask = nullptr;
+        unsigned *sq_array = nullptr;
+        unsigned sq_entries = 0;
+        unsigned *cq_head = nullptr;
+        unsigned *cq_tail = nullptr;
+        unsigned *cq_mask = nullptr;
+        io_uring_cqe *cqes = nullptr;
+
+        std::vector<iovec> iov;
+
+        ~Ring()
+        {
+            if (sqes != MAP_FAILED)
+                ::munmap(sqes, sqes_size);
+            if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+                ::munmap(cq_ptr, cq_size);
+            if (sq_ptr != MAP_FAILED)
+                ::munmap(sq_ptr, sq_size);
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        bool open()
+        {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            fd = static_cast<int>(::syscall(__NR_io_uring_setup, ENTRIES, &params));
+            if (fd < 0)
+                return false;
+
+            sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single)
+                sq_size = cq_size = std::max(sq_size, cq_size);
+
+            sq_ptr = ::mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_SQ_RING);
+            if (sq_ptr == MAP_FAILED)
+                return false;
+            cq_ptr = single ? sq_ptr
+                            : ::mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                     IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED)
+                return false;
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe *>(::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED)
+                return false;
+
+            auto *sq = static_cast<uint8_t *>(sq_ptr);
+            auto *cq = static_cast<uint8_t *>(cq_ptr);
+            sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            sq_entries = params.sq_entries;
+            cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            iov.resize(sq_entries);
+            return true;
+        }
+
+        int enter(unsigned to_submit, unsigned min_complete)
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                                              IORING_ENTER_GETEVENTS, nullptr, 0));
+        }
+    };
+#else
+    struct AsyncReader::Ring
+    {
+    };
+#endif
+
+    AsyncReader::AsyncReader(PageFile &file, unsigned threads, bool use_io_uring)
+        : file_(file)
+    {
+#if defined(DBONE_HAVE_IO_URING)
+        if (use_io_uring)
+        {
+            auto ring = std::make_unique<Ring>();
+            if (ring->open())
+                ring_ = std::move(ring);
+        }
+#else
+        (void)use_io_uring;
+#endif
+#if defined(_WIN32)
+        // PageFile emulates pread with seek + read on one FILE*.
+        threads = 0;
+#endif
+        if (!ring_)
+        {
+            for (unsigned i = 0; i < threads; i++)
+                threads_.emplace_back([this] { worker(); });
+        }
+    }
+
+    AsyncReader::~AsyncReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stopping_ = true;
+        }
+        work_cv_.notify_all();
+        for (std::thread &t : threads_)
+            t.join();
+    }
+
+    bool AsyncReader::read_batch(std::span<Request> requests)
+    {
+        if (requests.empty())
+            return true;
+        for (Request &request : requests)
+            request.ok = false;
+
+        if (requests.size() == 1)
+        {
+            run(requests[0]);
+            return requests[0].ok;
+        }
+        {
+            std::unique_lock<std::mutex> ring(ring_mu_, std::try_to_lock);
+            if (ring.owns_lock() && ring_)
+                return ring_batch(requests);
+        }
+        return pool_batch(requests);
+    }
+
+    bool AsyncReader::uses_io_uring() const
+    {
+        std::lock_guard<std::mutex> lock(ring_mu_);
+        return ring_ != nullptr;
+    }
+
+    void AsyncReader::run(Request &request)
+    {
+        request.ok = file_.read_at(request.offset, request.dst, request.len);
+    }
+
+#if defined(DBONE_HAVE_IO_URING)
+    bool AsyncReader::ring_batch(std::span<Request> requests)
+    {
+        Ring &ring = *ring_;
+        size_t submitted = 0;
+        while (submitted < requests.size())
+        {
+            unsigned n = static_cast<unsigned>(std::min<size_t>(requests.size() - submitted, ring.sq_entries));
+            unsigned tail = *ring.sq_tail;
+            const unsigned first = tail;
+            for (unsigned i = 0; i < n; i++)
+            {
+                Request &request = requests[submitted + i];
+                unsigned idx = tail & *ring.sq_mask;
+                ring.iov[i] = {request.dst, request.len};
+
+                io_uring_sqe &sqe = ring.sqes[idx];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_READV;
+                sqe.fd = file_.fd_;
+                sqe.addr = reinterpret_cast<uint64_t>(&ring.iov[i]);
+                sqe.len = 1;
+                sqe.off = request.offset;
+                sqe.user_data = submitted + i;
+                ring.sq_array[idx] = idx;
+                tail++;
+            }
+            std::atomic_ref<unsigned>(*ring.sq_tail).store(tail, std::memory_order_release);
+
+            unsigned to_submit = n;
+            unsigned reaped = 0;
+            bool failed = false;
+            while (true)
+            {
+                // Once enter has failed nothing more is submitted, but every
+                // SQE the kernel already took (those *sq_head has passed)
+                // still completes into its request's buffer, so wait for
+                // all of them before the ring or the buffers are let go.
+                unsigned taken = std::atomic_ref<unsigned>(*ring.sq_head).load(std::memory_order_acquire) - first;
+                unsigned wanted = failed ? taken : n;
+                if (reaped >= wanted)
+                    break;
+                int rc = ring.enter(failed ? 0 : to_submit, wanted - reaped);
+                if (rc < 0 && errno != EINTR)
+                {
+                    if (failed && errno != EAGAIN && errno != EBUSY)
+                    {
+                        // Can't wait for reads still in flight; returning
+                        // would hand their buffers back to the pool.
+                        std::abort();
+                    }
+                    failed = true;
+                }
+                else if (rc > 0 && !failed)
+                {
+                    to_submit -= std::min<unsigned>(to_submit, static_cast<unsigned>(rc));
+                }
+
+                unsigned head = *ring.cq_head;
+                unsigned cq_tail = std::atomic_ref<unsigned>(*ring.cq_tail).load(std::memory_order_acquire);
+                while (head != cq_tail)
+                {
+                    const io_uring_cqe &cqe = ring.cqes[head & *ring.cq_mask];
+                    Request &request = requests[cqe.user_data];
+                    size_t done = cqe.res > 0 ? static_cast<size_t>(cqe.res) : 0;
+                    if (done == request.len)
+                    {
+                        request.ok = true;
+                    }
+                    else
+                    {
+                        // Short read or error (EAGAIN and friends): let
+                        // pread finish the rest or report the failure.
+                        request.ok = file_.read_at(request.offset + done, request.dst + done, request.len - done);
+                    }
+                    head++;
+                    reaped++;
+                }
+                std::atomic_ref<unsigned>(*ring.cq_head).store(head, std::memory_order_release);
+            }
+            if (failed)
+            {
+                // The ring is in an unknown state but idle; drop it and
+                // finish on the calling thread.
+                ring_.reset();
+                for (size_t i = submitted; i < requests.size(); i++)
+                {
+                    if (!requests[i].ok)
+                        run(requests[i]);
+                }
+                break;
+            }
+            submitted += n;
+        }
+
+        return std::all_of(requests.begin(), requests.end(), [](const Request &r) { return r.ok; });
+    }
+#else
+    bool AsyncReader::ring_batch(std::span<Request> requests)
+    {
+        return pool_batch(requests);
+    }
+#endif
+
+    bool AsyncReader::pool_batch(std::span<Request> requests)
+    {
+        Batch batch{requests, 0, requests.size()};
+        std::unique_lock<std::mutex> lock(mu_);
+        queue_.push_back(&batch);
+        work_cv_.notify_all();
+
+        // The caller reads too, so a pool of n threads has n + 1 requests
+        // in flight.
+        while (batch.next < batch.requests.size())
+        {
+            Request &request = take(batch);
+            lock.unlock();
+            run(request);
+            lock.lock();
+            batch.remaining--;
+        }
+        done_cv_.wait(lock, [&batch] { return batch.remaining == 0; });
+
+        return std::all_of(requests.begin(), requests.end(), [](const Request &r) { return r.ok; });
+    }
+
+    void AsyncReader::worker()
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        while (true)
+        {
+            work_cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_)
+                return;
+
+            // The batch outlives this request: its caller waits for it
+            Batch &batch = *queue_.front();
+            Request &request = take(batch);
+            lock.unlock();
+            run(request);
+            lock.lock();
+            if (--batch.remaining == 0)
+                done_cv_.notify_all();
+        }
+    }
+
+    AsyncReader::Request &AsyncReader::take(Batch &batch)
+    {
+        Request &request = batch.requests[batch.next++];
+        if (batch.next == batch.requests.size())
+            queue_.erase(std::find(queue_.begin(), queue_.end(), &batch));
+        return request;
+    }
+
+} // namespace dbone::storage
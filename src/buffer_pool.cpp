@@ -0,0 +1,1070 @@
+#include "dbone/buffer_pool.hpp"
+#include "dbone/serialize.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+namespace dbone::storage
+{
+
+    namespace
+    {
+        std::mutex registry_mu;
+        std::unordered_map<std::string, std::shared_ptr<BufferPool>> registry;
+        BufferPool::Options default_options;
+
+        std::string registry_key(const std::string &path)
+        {
+            return std::filesystem::absolute(path).lexically_normal().string();
+        }
+    }
+
+    // --------- PageRef ----------
+    BufferPool::PageRef::PageRef(PageRef &&other) noexcept
+        : pool_(other.pool_), frame_(other.frame_), page_id_(other.page_id_), data_(other.data_),
+          mapping_(std::move(other.mapping_))
+    {
+        other.pool_ = nullptr;
+        other.data_ = nullptr;
+    }
+
+    BufferPool::PageRef &BufferPool::PageRef::operator=(PageRef &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            pool_ = other.pool_;
+            frame_ = other.frame_;
+            page_id_ = other.page_id_;
+            data_ = other.data_;
+            mapping_ = std::move(other.mapping_);
+            other.pool_ = nullptr;
+            other.data_ = nullptr;
+        }
+        return *this;
+    }
+
+    void BufferPool::PageRef::reset()
+    {
+        if (pool_)
+        {
+            if (frame_ != NO_FRAME)
+                pool_->unpin(frame_);
+            mapping_.reset();
+            pool_ = nullptr;
+            data_ = nullptr;
+        }
+    }
+
+    // --------- Transaction ----------
+    BufferPool::Transaction::~Transaction()
+    {
+        if (pool_)
+            pool_->abort_txn();
+    }
+
+    BufferPool::Transaction::Transaction(Transaction &&other) noexcept
+        : pool_(std::exchange(other.pool_, nullptr)), writer_(std::move(other.writer_))
+    {
+    }
+
+    BufferPool::Transaction &BufferPool::Transaction::operator=(Transaction &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (pool_)
+                pool_->abort_txn();
+            pool_ = std::exchange(other.pool_, nullptr);
+            writer_ = std::move(other.writer_);
+        }
+        return *this;
+    }
+
+    void BufferPool::Transaction::commit()
+    {
+        if (!pool_)
+            return;
+        BufferPool *pool = std::exchange(pool_, nullptr);
+
+        pool->flush_free_space();
+        uint64_t lsn = pool->commit_txn();
+        writer_.unlock();
+
+        if (lsn != 0)
+        {
+            pool->wal_->flush_to(lsn);
+            pool->write_back();
+        }
+    }
+
+    void BufferPool::Transaction::commit_and_continue()
+    {
+        if (!pool_)
+            return;
+
+        pool_->flush_free_space();
+        uint64_t lsn = pool_->commit_txn();
+        // Open the next one before waiting on the log, as commit() lets
+        // the next writer do; the writer lock stays with us.
+        pool_->start_txn();
+
+        if (lsn != 0)
+        {
+            pool_->wal_->flush_to(lsn);
+            pool_->write_back();
+        }
+    }
+
+    // --------- BufferPool ----------
+    BufferPool::BufferPool(const std::string &path, uint32_t page_size, const Options &options)
+        : path_(path),
+          page_size_(page_size),
+          max_frames_(std::max<size_t>(options.capacity_bytes / std::max<uint32_t>(page_size, 1), 8)),
+          io_mode_(options.io_mode),
+          file_(path)
+    {
+        if (page_size == 0)
+        {
+            throw std::runtime_error("BufferPool: page_size must be > 0");
+        }
+        if (!file_.is_open())
+        {
+            throw std::runtime_error("BufferPool: failed to open " + path);
+        }
+
+        // Must happen before anything reads the file.
+        stats_.recovered = WriteAheadLog::recover(WriteAheadLog::path_for(path), file_, page_size);
+        if (options.wal)
+        {
+            wal_ = std::make_unique<WriteAheadLog>(WriteAheadLog::path_for(path), page_size);
+            checkpoint_bytes_ = options.wal_checkpoint_bytes;
+        }
+
+        // O_DIRECT only after recovery, which writes from unaligned buffers.
+        if (io_mode_ == IoMode::Direct &&
+            (page_size_ % AlignedBuffer::ALIGNMENT != 0 || !file_.set_direct(true)))
+        {
+            io_mode_ = IoMode::Buffered;
+        }
+
+        end_page_ = file_.size() / page_size_;
+        reserved_bytes_ = end_page_ * page_size_;
+        grow_chunk_bytes_ = options.grow_chunk_bytes;
+
+        if (io_mode_ == IoMode::Mapped)
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            mapped_file_size_ = file_.size();
+            mapping_ = file_.map(std::max<uint64_t>(mapped_file_size_ * 2, page_size_));
+            if (!mapping_)
+            {
+                io_mode_ = IoMode::Buffered;
+            }
+        }
+        if (io_mode_ != IoMode::Mapped)
+        {
+            frames_.reserve(max_frames_);
+            reader_ = std::make_unique<AsyncReader>(file_, options.io_threads, options.io_uring);
+        }
+    }
+
+    BufferPool::~BufferPool()
+    {
+        try
+        {
+            Transaction txn = begin();
+            flush_free_space();
+            txn.commit();
+        }
+        catch (const std::exception &)
+        {
+            // Allocations since the last commit are lost; at worst pages leak.
+        }
+
+        if (!wal_)
+            return;
+        // Clean shutdown: everything logged is already in the table file,
+        // so the log can go.
+        std::lock_guard<std::mutex> lock(mu_);
+        if (pending_.empty() && !txn_open_ && file_.sync())
+        {
+            try
+            {
+                wal_->reset();
+            }
+            catch (const std::exception &)
+            {
+                // Left for recovery on the next open.
+            }
+        }
+    }
+
+    void BufferPool::ensure_mapped(uint32_t page_id)
+    {
+        uint64_t end = (static_cast<uint64_t>(page_id) + 1) * page_size_;
+        if (end <= mapped_file_size_)
+            return;
+
+        // Pages appended since the last check are already inside the mapping
+        // if it was made with enough slack; only remap past its end.
+        mapped_file_size_ = file_.size();
+        if (end > mapped_file_size_)
+        {
+            throw std::runtime_error("BufferPool: failed to read page " + std::to_string(page_id));
+        }
+        if (mapped_file_size_ > mapping_->size())
+        {
+            // Old mapping stays alive while PageRefs still point into it.
+            std::shared_ptr<MappedRegion> grown = file_.map(mapped_file_size_ * 2);
+            if (!grown)
+            {
+                throw std::runtime_error("BufferPool: failed to remap " + path_);
+            }
+            mapping_ = std::move(grown);
+            stats_.remaps++;
+        }
+    }
+
+    size_t BufferPool::grab_frame()
+    {
+        if (frames_.size() < max_frames_)
+        {
+            frames_.emplace_back();
+            frames_.back().data.resize(page_size_);
+            return frames_.size() - 1;
+        }
+
+        // CLOCK: clear reference bits on the first sweep, take the first
+        // unreferenced unpinned frame. Two sweeps are enough to find one if
+        // any frame is unpinned.
+        for (size_t step = 0; step < 2 * frames_.size(); step++)
+        {
+            size_t idx = clock_hand_;
+            clock_hand_ = (clock_hand_ + 1) % frames_.size();
+
+            Frame &frame = frames_[idx];
+            if (frame.pin_count > 0 || frame.dirty)
+                continue;
+            if (frame.valid && frame.referenced)
+            {
+                frame.referenced = false;
+                continue;
+            }
+            if (frame.valid)
+            {
+                page_table_.erase(frame.page_id);
+                frame.valid = false;
+                stats_.evictions++;
+            }
+            return idx;
+        }
+        return SIZE_MAX;
+    }
+
+    void BufferPool::unpin(size_t frame)
+    {
+        if (frame == PageRef::NO_FRAME)
+            return;
+        std::lock_guard<std::mutex> lock(mu_);
+        frames_[frame].pin_count--;
+    }
+
+    size_t BufferPool::find_frame(uint32_t page_id) const
+    {
+        if (txn_open_ && txn_owner_ == std::this_thread::get_id())
+        {
+            auto staged = txn_pages_.find(page_id);
+            if (staged != txn_pages_.end())
+                return staged->second;
+        }
+        auto it = page_table_.find(page_id);
+        return it == page_table_.end() ? SIZE_MAX : it->second;
+    }
+
+    void BufferPool::retire_frame(size_t idx)
+    {
+        Frame &frame = frames_[idx];
+        frame.valid = false;
+        frame.referenced = false;
+        frame.dirty = false;
+        frame.lsn = 0;
+    }
+
+    void BufferPool::start_load(size_t idx, uint32_t page_id)
+    {
+        Frame &frame = frames_[idx];
+        frame.page_id = page_id;
+        frame.valid = true;
+        frame.loading = true;
+        frame.referenced = true;
+        frame.pin_count = 1;
+        page_table_[page_id] = idx;
+    }
+
+    bool BufferPool::finish_load(size_t idx, uint32_t page_id, bool ok)
+    {
+        frames_[idx].loading = false;
+        auto it = page_table_.find(page_id);
+        bool current = it != page_table_.end() && it->second == idx;
+        if (ok && current)
+            return true;
+        // A write may have landed while the read was in flight, so even a
+        // good read can hold a torn or stale page.
+        if (current)
+            page_table_.erase(it);
+        retire_frame(idx);
+        return false;
+    }
+
+    BufferPool::PageRef BufferPool::fetch(uint32_t page_id)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        while (true)
+        {
+            // In Mapped mode the table only holds pages not yet written back.
+            size_t cached = find_frame(page_id);
+            if (cached != SIZE_MAX)
+            {
+                Frame &frame = frames_[cached];
+                if (frame.loading)
+                {
+                    load_cv_.wait(lock);
+                    continue;
+                }
+                frame.pin_count++;
+                frame.referenced = true;
+                stats_.hits++;
+                return PageRef(this, cached, page_id, frame.data.data());
+            }
+
+            if (io_mode_ == IoMode::Mapped)
+            {
+                ensure_mapped(page_id);
+                stats_.hits++;
+                const uint8_t *data = mapping_->data() + static_cast<uint64_t>(page_id) * page_size_;
+                return PageRef(this, mapping_, page_id, data);
+            }
+
+            stats_.misses++;
+            size_t idx = grab_frame();
+            if (idx == SIZE_MAX)
+            {
+                // Frames held by an uncommitted or unwritten transaction are
+                // not a leak; let the pool run over capacity until write-back.
+                if (!wal_)
+                    throw std::runtime_error("BufferPool: all frames are pinned");
+                idx = overflow_frame();
+            }
+            start_load(idx, page_id);
+            uint8_t *data = frames_[idx].data.data();
+
+            lock.unlock();
+            bool ok = file_.read_at(static_cast<uint64_t>(page_id) * page_size_, data, page_size_);
+            lock.lock();
+
+            stats_.read_calls++;
+            bool loaded = finish_load(idx, page_id, ok);
+            load_cv_.notify_all();
+            if (loaded)
+                return PageRef(this, idx, page_id, data);
+            frames_[idx].pin_count--;
+            if (!ok)
+            {
+                throw std::runtime_error("BufferPool: failed to read page " + std::to_string(page_id));
+            }
+            // Replaced while we read; the new copy is in the table.
+        }
+    }
+
+    void BufferPool::read_page(uint32_t page_id, uint8_t *dst)
+    {
+        PageRef ref = fetch(page_id);
+        std::memcpy(dst, ref.data(), page_size_);
+    }
+
+    void BufferPool::read_pages(std::span<const uint32_t> page_ids, uint8_t *dst)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+
+        struct Gap
+        {
+            size_t index;  // first page of the run in page_ids
+            size_t count;
+        };
+        std::vector<Gap> gaps;
+
+        size_t i = 0;
+        while (i < page_ids.size())
+        {
+            uint8_t *out = dst + i * page_size_;
+            size_t cached = find_frame(page_ids[i]);
+            if (cached != SIZE_MAX)
+            {
+                Frame &frame = frames_[cached];
+                if (frame.loading)
+                {
+                    // Someone else is reading it; start over once they're done.
+                    load_cv_.wait(lock);
+                    gaps.clear();
+                    i = 0;
+                    continue;
+                }
+                frame.referenced = true;
+                std::memcpy(out, frame.data.data(), page_size_);
+                stats_.hits++;
+                i++;
+                continue;
+            }
+            if (io_mode_ == IoMode::Mapped)
+            {
+                ensure_mapped(page_ids[i]);
+                std::memcpy(out, mapping_->data() + static_cast<uint64_t>(page_ids[i]) * page_size_, page_size_);
+                stats_.hits++;
+                i++;
+                continue;
+            }
+
+            // Run of adjacent uncached pages: one read for all of them.
+            size_t j = i + 1;
+            while (j < page_ids.size() && page_ids[j] == page_ids[j - 1] + 1 &&
+                   find_frame(page_ids[j]) == SIZE_MAX)
+                j++;
+            gaps.push_back({i, j - i});
+            i = j;
+        }
+        if (gaps.empty())
+            return;
+
+        // Claim a frame per missing page before letting go of mu_; a page
+        // id repeated in page_ids keeps the first claim.
+        std::vector<size_t> slots(page_ids.size(), SIZE_MAX);
+        size_t bounce = 0;
+        for (const Gap &gap : gaps)
+        {
+            for (size_t k = gap.index; k < gap.index + gap.count; k++)
+            {
+                if (page_table_.count(page_ids[k]) > 0)
+                    continue;
+                size_t idx = grab_frame();
+                if (idx == SIZE_MAX)
+                    idx = overflow_frame();
+                start_load(idx, page_ids[k]);
+                slots[k] = idx;
+            }
+            bounce += gap.count * page_size_;
+        }
+
+        // Direct mode reads into an aligned buffer of our own and copies out.
+        AlignedBuffer aligned;
+        if (io_mode_ == IoMode::Direct)
+            aligned.resize(bounce);
+
+        std::vector<AsyncReader::Request> requests(gaps.size());
+        size_t bounce_off = 0;
+        for (size_t g = 0; g < gaps.size(); g++)
+        {
+            AsyncReader::Request &request = requests[g];
+            request.offset = static_cast<uint64_t>(page_ids[gaps[g].index]) * page_size_;
+            request.len = gaps[g].count * page_size_;
+            if (aligned.size() > 0)
+            {
+                request.dst = aligned.data() + bounce_off;
+                bounce_off += request.len;
+            }
+            else
+            {
+                request.dst = dst + gaps[g].index * page_size_;
+            }
+        }
+
+        lock.unlock();
+        reader_->read_batch(requests);
+        lock.lock();
+
+        stats_.read_calls += requests.size();
+        if (requests.size() > 1)
+            stats_.read_batches++;
+
+        std::vector<size_t> replaced; // indexes into page_ids to read again
+        const Gap *failed = nullptr;
+        for (size_t g = 0; g < gaps.size(); g++)
+        {
+            uint8_t *out = dst + gaps[g].index * page_size_;
+            if (requests[g].ok && aligned.size() > 0)
+                std::memcpy(out, requests[g].dst, requests[g].len);
+            if (!requests[g].ok && !failed)
+                failed = &gaps[g];
+            stats_.misses += gaps[g].count;
+            for (size_t k = 0; k < gaps[g].count; k++)
+            {
+                size_t at = gaps[g].index + k;
+                if (slots[at] == SIZE_MAX)
+                {
+                    // Repeat of a page claimed earlier; copy that one.
+                    replaced.push_back(at);
+                    continue;
+                }
+                Frame &frame = frames_[slots[at]];
+                if (finish_load(slots[at], page_ids[at], requests[g].ok))
+                    std::memcpy(frame.data.data(), out + k * page_size_, page_size_);
+                else
+                    replaced.push_back(at);
+                frame.pin_count--;
+            }
+        }
+        load_cv_.notify_all();
+        lock.unlock();
+
+        if (failed)
+        {
+            uint32_t first = page_ids[failed->index];
+            throw std::runtime_error("BufferPool: failed to read pages " + std::to_string(first) + ".." +
+                                     std::to_string(first + failed->count - 1));
+        }
+        // A write got to these pages during the read; take its copy.
+        for (size_t at : replaced)
+        {
+            read_page(page_ids[at], dst + at * page_size_);
+        }
+    }
+
+    void BufferPool::prefetch(std::span<const uint32_t> page_ids)
+    {
+        if (io_mode_ == IoMode::Mapped)
+            return;
+        std::unique_lock<std::mutex> lock(mu_);
+
+        // Leave most of the pool alone so a wide node cannot flush it.
+        size_t limit = std::max<size_t>(max_frames_ / 4, 1);
+        uint64_t file_pages = file_.size() / page_size_;
+
+        std::vector<std::pair<uint32_t, size_t>> slots; // page id, frame
+        std::vector<AsyncReader::Request> requests;
+        for (uint32_t page_id : page_ids)
+        {
+            if (requests.size() >= limit)
+                break;
+            // Also skips pages already queued: start_load put them in the table
+            if (page_id >= file_pages || page_table_.count(page_id) > 0)
+                continue;
+
+            size_t idx = grab_frame();
+            if (idx == SIZE_MAX)
+                break;
+            start_load(idx, page_id);
+            slots.emplace_back(page_id, idx);
+
+            AsyncReader::Request request;
+            request.offset = static_cast<uint64_t>(page_id) * page_size_;
+            request.dst = frames_[idx].data.data();
+            request.len = page_size_;
+            requests.push_back(request);
+        }
+        if (requests.empty())
+            return;
+
+        lock.unlock();
+        reader_->read_batch(requests);
+        lock.lock();
+
+        stats_.read_calls += requests.size();
+        if (requests.size() > 1)
+            stats_.read_batches++;
+        for (size_t r = 0; r < requests.size(); r++)
+        {
+            const auto &[page_id, idx] = slots[r];
+            bool loaded = finish_load(idx, page_id, requests[r].ok);
+            frames_[idx].pin_count--;
+            if (!loaded)
+                continue;
+            stats_.misses++;
+            stats_.prefetched++;
+        }
+        load_cv_.notify_all();
+    }
+
+    void BufferPool::write_page(uint32_t page_id, const uint8_t *src)
+    {
+        write_pages(std::span<const uint32_t>(&page_id, 1), src);
+    }
+
+    void BufferPool::write_pages(std::span<const uint32_t> page_ids, const uint8_t *src)
+    {
+        if (wal_)
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            if (txn_open_ && txn_owner_ == std::this_thread::get_id())
+            {
+                stage_pages(page_ids, src);
+                return;
+            }
+            // A lone write outside any transaction commits on its own.
+            lock.unlock();
+            Transaction txn = begin();
+            write_pages(page_ids, src);
+            txn.commit();
+            return;
+        }
+
+        std::vector<std::pair<uint32_t, const uint8_t *>> pages;
+        pages.reserve(page_ids.size());
+        for (size_t i = 0; i < page_ids.size(); i++)
+        {
+            pages.emplace_back(page_ids[i], src + i * page_size_);
+        }
+
+        std::lock_guard<std::mutex> lock(mu_);
+        write_runs(pages);
+        for (size_t i = 0; i < page_ids.size(); i++)
+        {
+            cache_written(page_ids[i], src + i * page_size_);
+        }
+    }
+
+    void BufferPool::write_runs(std::vector<std::pair<uint32_t, const uint8_t *>> &pages)
+    {
+        std::stable_sort(pages.begin(), pages.end(),
+                         [](const auto &a, const auto &b) { return a.first < b.first; });
+
+        std::vector<const uint8_t *> run;
+        size_t i = 0;
+        while (i < pages.size())
+        {
+            uint32_t first = pages[i].first;
+            run.clear();
+            run.push_back(pages[i].second);
+
+            size_t j = i + 1;
+            while (j < pages.size() && pages[j].first == first + (j - i))
+            {
+                run.push_back(pages[j].second);
+                j++;
+            }
+
+            bool ok;
+            if (io_mode_ == IoMode::Direct)
+            {
+                // Callers' buffers are not aligned; gather into ours.
+                size_t len = run.size() * page_size_;
+                if (io_buffer_.size() < len)
+                    io_buffer_.resize(len);
+                for (size_t k = 0; k < run.size(); k++)
+                {
+                    std::memcpy(io_buffer_.data() + k * page_size_, run[k], page_size_);
+                }
+                ok = file_.write_at(static_cast<uint64_t>(first) * page_size_, io_buffer_.data(), len);
+            }
+            else
+            {
+                ok = file_.write_gather_at(static_cast<uint64_t>(first) * page_size_, run, page_size_);
+            }
+            if (!ok)
+            {
+                throw std::runtime_error("BufferPool: failed to write pages " + std::to_string(first) +
+                                         ".." + std::to_string(first + run.size() - 1));
+            }
+            stats_.write_calls++;
+            end_page_ = std::max<uint64_t>(end_page_, static_cast<uint64_t>(first) + run.size());
+            i = j;
+        }
+    }
+
+    size_t BufferPool::overflow_frame()
+    {
+        frames_.emplace_back();
+        frames_.back().data.resize(page_size_);
+        return frames_.size() - 1;
+    }
+
+    size_t BufferPool::txn_frame(uint32_t page_id)
+    {
+        auto it = txn_pages_.find(page_id);
+        if (it != txn_pages_.end() && frames_[it->second].pin_count == 0)
+            return it->second;
+
+        // Dirty until commit or abort, so never evicted
+        size_t idx = grab_frame();
+        if (idx == SIZE_MAX)
+            idx = overflow_frame();
+        Frame &frame = frames_[idx];
+        frame.page_id = page_id;
+        frame.valid = true;
+        frame.referenced = true;
+        frame.dirty = true;
+        frame.lsn = TXN_LSN;
+
+        if (it != txn_pages_.end())
+        {
+            // This thread still reads the earlier staged copy
+            retire_frame(it->second);
+            it->second = idx;
+        }
+        else
+        {
+            txn_pages_[page_id] = idx;
+        }
+        return idx;
+    }
+
+    void BufferPool::stage_pages(std::span<const uint32_t> page_ids, const uint8_t *src)
+    {
+        for (size_t i = 0; i < page_ids.size(); i++)
+        {
+            Frame &frame = frames_[txn_frame(page_ids[i])];
+            std::memcpy(frame.data.data(), src + i * page_size_, page_size_);
+            end_page_ = std::max<uint64_t>(end_page_, static_cast<uint64_t>(page_ids[i]) + 1);
+        }
+    }
+
+    BufferPool::Transaction BufferPool::begin()
+    {
+        std::unique_lock<std::mutex> writer(writer_mu_);
+        start_txn();
+        return Transaction(this, std::move(writer));
+    }
+
+    void BufferPool::start_txn()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        txn_open_ = true;
+        txn_owner_ = std::this_thread::get_id();
+        txn_pages_.clear();
+        txn_end_page_ = end_page_;
+    }
+
+    FreeSpaceMap &BufferPool::free_space(uint32_t root_page)
+    {
+        std::lock_guard<std::mutex> lock(fsm_mu_);
+        if (!fsm_)
+        {
+            fsm_ = std::make_unique<FreeSpaceMap>(*this, root_page);
+        }
+        return *fsm_;
+    }
+
+    std::optional<bool> BufferPool::is_free(uint32_t page) const
+    {
+        std::lock_guard<std::mutex> lock(fsm_mu_);
+        if (!fsm_)
+            return std::nullopt;
+        return fsm_->is_free(page);
+    }
+
+    std::vector<uint32_t> BufferPool::right_edge(uint32_t root_page) const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = right_edges_.find(root_page);
+        return it == right_edges_.end() ? std::vector<uint32_t>() : it->second;
+    }
+
+    void BufferPool::set_right_edge(uint32_t root_page, std::vector<uint32_t> pages)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (pages.empty())
+            right_edges_.erase(root_page);
+        else
+            right_edges_[root_page] = std::move(pages);
+    }
+
+    void BufferPool::flush_free_space()
+    {
+        std::lock_guard<std::mutex> lock(fsm_mu_);
+        if (fsm_)
+            fsm_->flush();
+    }
+
+    uint64_t BufferPool::commit_txn()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        txn_open_ = false;
+        if (txn_pages_.empty())
+            return 0;
+
+        std::vector<WriteAheadLog::PageImage> images;
+        images.reserve(txn_pages_.size());
+        for (const auto &[page_id, idx] : txn_pages_)
+        {
+            images.push_back({page_id, frames_[idx].data.data()});
+        }
+        uint64_t lsn = wal_->append(images);
+
+        for (const auto &[page_id, idx] : txn_pages_)
+        {
+            Frame &frame = frames_[idx];
+            frame.lsn = lsn;
+            pending_[page_id] = PendingPage{lsn, std::vector<uint8_t>(frame.data.data(), frame.data.data() + page_size_)};
+
+            // Publish; readers still on the old image keep it until they unpin
+            auto it = page_table_.find(page_id);
+            if (it != page_table_.end())
+                retire_frame(it->second);
+            page_table_[page_id] = idx;
+        }
+        txn_pages_.clear();
+        stats_.commits++;
+        return lsn;
+    }
+
+    void BufferPool::abort_txn()
+    {
+        {
+            // With a WAL the map's in-memory state may describe writes that
+            // are about to be rolled back; reload it from disk on next use.
+            // Without one those writes are already on disk, so keep it.
+            std::lock_guard<std::mutex> fsm_lock(fsm_mu_);
+            if (wal_)
+            {
+                fsm_.reset();
+            }
+            else if (fsm_)
+            {
+                try
+                {
+                    fsm_->flush();
+                }
+                catch (const std::exception &)
+                {
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mu_);
+        txn_open_ = false;
+        // The aborted change may have moved a right edge.
+        right_edges_.clear();
+        if (wal_)
+        {
+            // Nothing handed out since begin() ever reached the file.
+            end_page_ = txn_end_page_;
+        }
+        // page_table_ still holds the committed images; drop the staged ones.
+        for (const auto &[page_id, idx] : txn_pages_)
+        {
+            retire_frame(idx);
+        }
+        txn_pages_.clear();
+    }
+
+    void BufferPool::write_back()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        uint64_t durable = wal_->durable_lsn();
+
+        std::vector<std::pair<uint32_t, const uint8_t *>> pages;
+        for (const auto &[page_id, pending] : pending_)
+        {
+            if (pending.lsn <= durable)
+                pages.emplace_back(page_id, pending.image.data());
+        }
+        write_runs(pages);
+
+        for (const auto &[page_id, data] : pages)
+        {
+            uint64_t lsn = pending_.at(page_id).lsn;
+            auto it = page_table_.find(page_id);
+            if (it != page_table_.end())
+            {
+                Frame &frame = frames_[it->second];
+                if (frame.lsn <= lsn)
+                {
+                    frame.dirty = false;
+                    // The mapping serves this page again from here on.
+                    if (io_mode_ == IoMode::Mapped && frame.pin_count == 0)
+                    {
+                        frame.valid = false;
+                        page_table_.erase(it);
+                    }
+                }
+            }
+            pending_.erase(page_id);
+        }
+
+        if (pending_.empty() && wal_->file_bytes() >= checkpoint_bytes_)
+        {
+            if (!file_.sync())
+            {
+                throw std::runtime_error("BufferPool: failed to sync " + path_);
+            }
+            if (wal_->reset())
+                stats_.checkpoints++;
+        }
+    }
+
+    void BufferPool::cache_written(uint32_t page_id, const uint8_t *src)
+    {
+        // The shared mapping sees the write without any further work.
+        if (io_mode_ == IoMode::Mapped)
+            return;
+
+        size_t idx;
+        auto it = page_table_.find(page_id);
+        if (it != page_table_.end() && frames_[it->second].pin_count == 0)
+        {
+            idx = it->second;
+        }
+        else
+        {
+            // A pinned copy is being read in place; leave it to its readers.
+            if (it != page_table_.end())
+            {
+                retire_frame(it->second);
+                page_table_.erase(it);
+            }
+            // Freshly written pages (new nodes, split halves) are usually
+            // read back straight away, so cache them too.
+            idx = grab_frame();
+            if (idx == SIZE_MAX)
+                return;
+            page_table_[page_id] = idx;
+        }
+
+        Frame &frame = frames_[idx];
+        std::memcpy(frame.data.data(), src, page_size_);
+        frame.page_id = page_id;
+        frame.valid = true;
+        frame.referenced = true;
+    }
+
+    void BufferPool::invalidate()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        right_edges_.clear();
+        for (size_t i = 0; i < frames_.size(); i++)
+        {
+            Frame &frame = frames_[i];
+            if (frame.valid && frame.pin_count == 0 && !frame.dirty)
+            {
+                page_table_.erase(frame.page_id);
+                frame.valid = false;
+            }
+        }
+    }
+
+    uint32_t BufferPool::allocate_pages(uint32_t n)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        uint64_t first = end_page_;
+        if (first + n > UINT32_MAX)
+        {
+            throw std::runtime_error("BufferPool: page ids exhausted in " + path_);
+        }
+        end_page_ = first + n;
+
+        uint64_t end_bytes = end_page_ * page_size_;
+        if (grow_chunk_bytes_ > 0 && end_bytes > reserved_bytes_)
+        {
+            // Small tables double their reservation, big ones grow a whole
+            // chunk at a time. A failed reservation only costs contiguity;
+            // the writes themselves still grow the file.
+            uint64_t step = std::min(grow_chunk_bytes_, std::max<uint64_t>(reserved_bytes_, 64 * 1024));
+            uint64_t len = (end_bytes - reserved_bytes_ + step - 1) / step * step;
+            if (file_.reserve(reserved_bytes_, len))
+                stats_.reservations++;
+            reserved_bytes_ += len;
+        }
+        return static_cast<uint32_t>(first);
+    }
+
+    uint64_t BufferPool::page_count() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return end_page_;
+    }
+
+    BufferPool::Stats BufferPool::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        Stats stats = stats_;
+        if (wal_)
+            stats.log_flushes = wal_->stats().flushes;
+        return stats;
+    }
+
+    // --------- registry ----------
+    std::shared_ptr<BufferPool> BufferPool::shared(const std::string &path, uint32_t page_size)
+    {
+        Options options;
+        {
+            std::lock_guard<std::mutex> lock(registry_mu);
+            options = default_options;
+        }
+        return shared(path, page_size, options);
+    }
+
+    std::shared_ptr<BufferPool> BufferPool::shared(const std::string &path, uint32_t page_size, const Options &options)
+    {
+        std::string key = registry_key(path);
+
+        std::lock_guard<std::mutex> lock(registry_mu);
+        auto it = registry.find(key);
+        if (it != registry.end())
+        {
+            if (it->second->page_size() != page_size)
+            {
+                throw std::runtime_error("BufferPool: " + path + " already open with page size " +
+                                         std::to_string(it->second->page_size()));
+            }
+            return it->second;
+        }
+
+        auto pool = std::make_shared<BufferPool>(path, page_size, options);
+        registry[key] = pool;
+        return pool;
+    }
+
+    void BufferPool::release(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(registry_mu);
+        registry.erase(registry_key(path));
+    }
+
+    void BufferPool::set_default_options(const Options &options)
+    {
+        std::lock_guard<std::mutex> lock(registry_mu);
+        default_options = options;
+    }
+
+    // --------- page chains ----------
+    std::span<const uint8_t> PageChain::bytes() const
+    {
+        if (!assembled_.empty())
+            return assembled_;
+        return std::span<const uint8_t>(root_.data() + header_size_, page_size_ - header_size_);
+    }
+
+    PageChain read_page_chain(BufferPool &pool, uint32_t root_page)
+    {
+        PageChain chain;
+        chain.page_size_ = pool.page_size();
+        chain.root_ = pool.fetch(root_page);
+        std::span<const uint8_t> root(chain.root_.data(), chain.page_size_);
+
+        size_t off = 0;
+        uint32_t page_count = readU32(root, off);
+        chain.header_size_ = 4u + 4u * static_cast<size_t>(page_count);
+        if (chain.header_size_ > chain.page_size_)
+        {
+            throw std::runtime_error("read_page_chain: header too large at page " + std::to_string(root_page));
+        }
+
+        chain.pages_.reserve(page_count);
+        for (uint32_t i = 0; i < page_count; i++)
+        {
+            chain.pages_.push_back(readU32(root, off));
+        }
+
+        if (page_count > 0)
+        {
+            size_t root_bytes = chain.page_size_ - chain.header_size_;
+            chain.assembled_.resize(root_bytes + chain.page_size_ * page_count);
+            std::memcpy(chain.assembled_.data(), root.data() + chain.header_size_, root_bytes);
+            chain.root_.reset();
+
+            pool.read_pages(chain.pages_, chain.assembled_.data() + root_bytes);
+        }
+        return chain;
+    }
+
+} // namespace dbone::storage
@@ -0,0 +1,409 @@
+#include "dbone/insert.hpp"
+#include "dbone/schema.hpp"
+#include "dbone/clustered_index_node.hpp"
+#include "dbone/secondary_index_node.hpp"
+#include "dbone/buffer_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <vector>
+
+namespace dbone::insert
+{
+
+    namespace
+    {
+        // Shared by the trees of one load. Node writes are committed in
+        // batches so a WAL never holds more than a batch of pages, but the
+        // writer lock is kept throughout; nothing is reachable until the
+        // roots are written at the end.
+        struct LoadContext
+        {
+            static constexpr size_t NODES_PER_COMMIT = 256;
+
+            const std::string &db_path;
+            const TableSchema &schema;
+            uint32_t page_size;
+            std::shared_ptr<storage::BufferPool> pool;
+            storage::BufferPool::Transaction txn;
+            storage::FreeSpaceMap &fsm;
+            size_t uncommitted = 0;
+            std::vector<uint32_t> pages; // every page taken, overflow pages included
+            std::vector<uint32_t> roots; // table roots written
+
+            uint32_t allocate()
+            {
+                uint32_t page = fsm.allocate();
+                pages.push_back(page);
+                return page;
+            }
+
+            void written(const std::vector<uint32_t> &used)
+            {
+                pages.insert(pages.end(), used.begin(), used.end());
+                if (++uncommitted == NODES_PER_COMMIT)
+                {
+                    txn.commit_and_continue();
+                    uncommitted = 0;
+                }
+            }
+
+            // Undo a failed load in its last transaction: the roots it
+            // wrote are empty again and every other page it took is free
+            void abandon()
+            {
+                std::vector<uint8_t> empty(page_size, 0);
+                for (uint32_t root : roots)
+                {
+                    pool->write_page(root, empty.data());
+                }
+                std::sort(pages.begin(), pages.end());
+                pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+                for (uint32_t page : pages)
+                {
+                    if (std::find(roots.begin(), roots.end(), page) == roots.end())
+                    {
+                        fsm.free_page(page);
+                    }
+                }
+                txn.commit();
+            }
+        };
+
+        // Builds one tree bottom-up from items in key order. Every level
+        // fills one node at a time; a node that reaches its quota is
+        // written out and the next item goes up a level, as the separator
+        // between it and the node after it. For a B+tree (given separator
+        // and link_leaf) the item starts the next leaf instead and a
+        // separator between the full leaf and it goes up; each leaf is
+        // written once the page of the next one is known, linked to both
+        // neighbours.
+        template <typename Node, typename Item>
+        class TreeBuilder
+        {
+        public:
+            using AddItem = void (*)(Node &, Item &&);
+            using Separator = Item (*)(Node &leaf, const Item &next);
+            using LinkLeaf = void (*)(Node &, uint32_t prev, uint32_t next);
+
+            TreeBuilder(LoadContext &ctx, size_t per_node, AddItem add_item,
+                        Separator separator = nullptr, LinkLeaf link_leaf = nullptr)
+                : ctx_(ctx), per_node_(per_node), add_item_(add_item), separator_(separator), link_leaf_(link_leaf)
+            {
+                levels_.emplace_back();
+                levels_[0].node.add_pointer(0);
+            }
+
+            // Record in pages[i] the page the i-th item added is written to
+            void locate(std::vector<uint32_t> &pages) { located_ = &pages; }
+
+            void add(Item &&item)
+            {
+                size_t number = added_++;
+                if (levels_[0].items == per_node_)
+                {
+                    if (!separator_)
+                    {
+                        uint32_t page = write(0, ctx_.allocate());
+                        push(std::move(item), page, 1, number);
+                        return;
+                    }
+                    Item up = separator_(levels_[0].node, item);
+                    uint32_t page = leaf_page_ != 0 ? leaf_page_ : ctx_.allocate();
+                    leaf_page_ = ctx_.allocate();
+                    write_leaf(page, leaf_page_);
+                    push(std::move(up), page, 1, SEPARATOR);
+                }
+                Level &leaf = levels_[0];
+                add_item_(leaf.node, std::move(item));
+                leaf.node.add_pointer(0);
+                leaf.numbers.push_back(number);
+                leaf.items++;
+            }
+
+            // Write the nodes still open, the top one to root_page. Returns
+            // the right edge of the tree, root first.
+            std::vector<uint32_t> finish(uint32_t root_page)
+            {
+                std::vector<uint32_t> edge;
+                uint32_t child = 0;
+                for (size_t level = 0; level < levels_.size(); level++)
+                {
+                    if (level > 0)
+                    {
+                        levels_[level].node.add_pointer(child);
+                    }
+                    uint32_t page = root_page;
+                    if (level + 1 < levels_.size())
+                    {
+                        // A B+tree's last leaf got its page when the one before filled
+                        page = level == 0 && leaf_page_ != 0 ? leaf_page_ : ctx_.allocate();
+                    }
+                    else
+                    {
+                        ctx_.roots.push_back(root_page);
+                    }
+                    child = level == 0 && separator_ ? write_leaf(page, 0) : write(level, page);
+                    edge.push_back(child);
+                }
+                std::reverse(edge.begin(), edge.end());
+                return edge;
+            }
+
+        private:
+            static constexpr size_t SEPARATOR = static_cast<size_t>(-1);
+
+            struct Level
+            {
+                Node node;
+                size_t items = 0;
+                std::vector<size_t> numbers; // of each item in add() order, SEPARATOR for B+tree separators
+            };
+
+            void push(Item &&item, uint32_t left, size_t level, size_t number)
+            {
+                if (level == levels_.size())
+                {
+                    levels_.emplace_back();
+                }
+                Level &current = levels_[level];
+                current.node.add_pointer(left);
+                if (current.items == per_node_)
+                {
+                    uint32_t page = write(level, ctx_.allocate());
+                    push(std::move(item), page, level + 1, number);
+                    return;
+                }
+                add_item_(current.node, std::move(item));
+                current.numbers.push_back(number);
+                current.items++;
+            }
+
+            uint32_t write_leaf(uint32_t page, uint32_t next)
+            {
+                link_leaf_(levels_[0].node, prev_leaf_, next);
+                prev_leaf_ = page;
+                return write(0, page);
+            }
+
+            uint32_t write(size_t level, uint32_t page)
+            {
+                Level &current = levels_[level];
+                current.node.set_original_page(page);
+                std::vector<uint32_t> used = current.node.save(ctx_.db_path, ctx_.schema, ctx_.page_size);
+                for (size_t number : located_ ? current.numbers : std::vector<size_t>())
+                {
+                    if (number == SEPARATOR)
+                    {
+                        continue;
+                    }
+                    if (number >= located_->size())
+                    {
+                        located_->resize(number + 1);
+                    }
+                    (*located_)[number] = page;
+                }
+                current = Level();
+                if (level == 0)
+                {
+                    current.node.add_pointer(0);
+                }
+                ctx_.written(used);
+                return page;
+            }
+
+            LoadContext &ctx_;
+            size_t per_node_;
+            AddItem add_item_;
+            Separator separator_;
+            LinkLeaf link_leaf_;
+            uint32_t leaf_page_ = 0; // B+tree: page of the open leaf, once known
+            uint32_t prev_leaf_ = 0;
+            size_t added_ = 0;
+            std::vector<uint32_t> *located_ = nullptr;
+            std::vector<Level> levels_; // leaves first
+        };
+
+        void add_row(ClusteredIndexNode &node, DataRow &&row)
+        {
+            node.add_row(std::move(row));
+        }
+
+        DataRow separator(ClusteredIndexNode &leaf, const DataRow &next)
+        {
+            return DataRow::separator(leaf.get_items().back(), next);
+        }
+
+        void link_leaf(ClusteredIndexNode &node, uint32_t prev, uint32_t next)
+        {
+            node.set_leaf_links(prev, next);
+        }
+
+        void add_entry(SecondaryIndexNode &node, IndexEntry &&entry)
+        {
+            node.add_entry(std::move(entry));
+        }
+
+        struct Posting
+        {
+            std::unique_ptr<DataType> value;
+            std::unique_ptr<DataType> primary_key;
+            size_t row; // position in the input
+            std::vector<std::unique_ptr<DataType>> included;
+        };
+        // Every tree of the load, rows first; edge gets the right edge of
+        // the clustered tree
+        ValidationResult build(LoadContext &ctx, const RowSource &rows, size_t per_node, std::vector<uint32_t> &edge)
+        {
+            const TableSchema &schema = ctx.schema;
+
+            // Clustered index straight from the input; each secondary index
+            // collects (value, key) pairs to sort once the input is done.
+            TreeBuilder<ClusteredIndexNode, DataRow> clustered(ctx, per_node, add_row, schema.bplus_tree ? separator : nullptr,
+                                                               schema.bplus_tree ? link_leaf : nullptr);
+            std::vector<std::pair<size_t, std::vector<Posting>>> postings;
+            for (const auto &[colIndex, pageRef] : schema.index_page_refs)
+            {
+                postings.emplace_back(colIndex, std::vector<Posting>());
+            }
+            // With index locators: the page each input row is written to
+            std::vector<uint32_t> located;
+            if (schema.index_locators && !postings.empty())
+            {
+                clustered.locate(located);
+            }
+            size_t count = 0;
+
+            std::unique_ptr<DataType> last_key;
+            Row row;
+            while (rows(row))
+            {
+                ValidationResult validationResult = validate_row(schema, row);
+                if (!validationResult.ok)
+                {
+                    return validationResult;
+                }
+
+                DataRow dataRow = DataRow::fromRow(row, schema);
+                const DataType &key = dataRow.get(*dataRow.primaryKeyIndex());
+                if (last_key && !(*last_key < key))
+                {
+                    return {false, "bulk_load: rows are not in ascending primary key order (at " + key.default_value_str() + ")"};
+                }
+                last_key = key.clone();
+
+                for (auto &[colIndex, list] : postings)
+                {
+                    const Column &col = *schema.columns[colIndex];
+                    list.push_back({col.parse(row.at(col.name())), key.clone(), count, included_values(schema, colIndex, dataRow)});
+                }
+                clustered.add(std::move(dataRow));
+                count++;
+                row.clear();
+            }
+            edge = clustered.finish(*schema.clustered_page_ref);
+
+            for (auto &[colIndex, list] : postings)
+            {
+                // Stable, so the keys of equal values stay in ascending order
+                std::stable_sort(list.begin(), list.end(), [](const Posting &a, const Posting &b)
+                                 { return *a.value < *b.value; });
+
+                TreeBuilder<SecondaryIndexNode, IndexEntry> index(ctx, per_node, add_entry);
+                std::optional<IndexEntry> entry;
+                for (Posting &posting : list)
+                {
+                    if (entry && !(*entry->value == *posting.value))
+                    {
+                        index.add(std::move(*entry));
+                        entry.reset();
+                    }
+                    if (!entry)
+                    {
+                        entry.emplace(std::move(posting.value));
+                    }
+                    entry->primary_keys.push_back(std::move(posting.primary_key));
+                    if (schema.index_locators)
+                    {
+                        entry->locators.push_back(located[posting.row]);
+                    }
+                    if (!posting.included.empty())
+                    {
+                        entry->included.push_back(std::move(posting.included));
+                    }
+                }
+                if (entry)
+                {
+                    index.add(std::move(*entry));
+                }
+                list.clear();
+                index.finish(schema.index_page_refs.at(colIndex));
+            }
+            return {true, ""};
+        }
+
+    } // namespace
+
+    ValidationResult bulk_load(const std::string &db_path, const RowSource &rows, double fill_factor, uint32_t page_size)
+    {
+        TableSchema schema = read_schema(db_path, page_size);
+        return bulk_load(db_path, schema, rows, fill_factor, page_size);
+    }
+
+    ValidationResult bulk_load(const std::string &db_path, const TableSchema &schema, const RowSource &rows, double fill_factor, uint32_t page_size)
+    {
+        if (!(fill_factor > 0.0 && fill_factor <= 1.0))
+        {
+            return {false, "bulk_load: fill_factor must be in (0, 1]"};
+        }
+        const size_t max_items = schema.min_length * 2 + 1;
+        const size_t per_node = std::max<size_t>(1, static_cast<size_t>(std::floor(fill_factor * static_cast<double>(max_items))));
+
+        std::optional<size_t> pk_index = primary_key_index(schema);
+        if (!pk_index)
+        {
+            return {false, "bulk_load: table has no primary key"};
+        }
+        const Column &pk_col = *schema.columns[*pk_index];
+
+        // Other writers wait until the load is done, so the table can't
+        // stop being empty under it
+        std::shared_ptr<storage::BufferPool> pool = storage::BufferPool::shared(db_path, page_size);
+        storage::BufferPool::Transaction txn = pool->begin();
+        if (ClusteredIndexNodeView::load(db_path, *schema.clustered_page_ref, schema, page_size).size() != 0)
+        {
+            return {false, "bulk_load: table is not empty"};
+        }
+        for (const auto &[colIndex, pageRef] : schema.index_page_refs)
+        {
+            if (!SecondaryIndexNode::load(db_path, pageRef, schema, *schema.columns[colIndex], pk_col, page_size).entries().empty())
+            {
+                return {false, "bulk_load: index on " + schema.columns[colIndex]->name() + " is not empty"};
+            }
+        }
+
+        pool->set_right_edge(*schema.clustered_page_ref, {});
+        LoadContext ctx{db_path, schema, page_size, pool, std::move(txn), pool->free_space(*schema.available_pages_ref), 0, {}, {}};
+        std::vector<uint32_t> edge;
+        ValidationResult result;
+        try
+        {
+            result = build(ctx, rows, per_node, edge);
+        }
+        catch (...)
+        {
+            ctx.abandon();
+            throw;
+        }
+        if (!result.ok)
+        {
+            ctx.abandon();
+            return result;
+        }
+
+        ctx.txn.commit();
+        pool->set_right_edge(*schema.clustered_page_ref, std::move(edge));
+        return {true, ""};
+    }
+
+} // namespace dbone::insert
@@ -2,10 +2,13 @@
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
-#include <fstream>
 #include <filesystem>
-#include "dbone/availablePages.hpp"
+#include <cstring>
+#include <string_view>
+#include "dbone/buffer_pool.hpp"
 #include "dbone/clustered_index_node.hpp"
+#include "dbone/key_search.hpp"
+#include "dbone/secondary_index_node.hpp"
 #include <dbone/serialize.hpp>
 // Add a row
 void ClusteredIndexNode::add_row(DataRow &&row)
@@ -15,94 +18,247 @@ void ClusteredIndexNode::add_row(DataRow &&row)
 
 ClusteredIndexNode ClusteredIndexNode::load(const std::string &db_path, uint32_t page_num, const TableSchema &schema, uint32_t page_size)
 {
-    // InsertIntoResult insertionResult;
-    // --- Read clustered index page ---
-    std::ifstream in(db_path, std::ios::binary);
-    if (!in)
-    {
-        throw std::runtime_error("Couldn't open path (00)");
-    }
+    return load(ClusteredIndexNodeView::load(db_path, page_num, schema, page_size));
+}
 
-    uint64_t offset = static_cast<uint64_t>(page_num) * page_size;
-    in.seekg(offset, std::ios::beg);
+ClusteredIndexNode ClusteredIndexNode::load(ClusteredIndexNodeView &&source)
+{
+    // Taken over here so the pages are unpinned before the node is written
+    ClusteredIndexNodeView view = std::move(source);
 
-    if (!in)
+    ClusteredIndexNode clusteredIndexNode;
+    clusteredIndexNode.set_available_pages(view.chain_.pages());
+    clusteredIndexNode.set_original_page(view.page_num_);
+    clusteredIndexNode.page_pointers_ = std::move(view.pointers_);
+    clusteredIndexNode.linked_ = view.linked_;
+    clusteredIndexNode.prev_leaf_ = view.prev_leaf_;
+    clusteredIndexNode.next_leaf_ = view.next_leaf_;
+    clusteredIndexNode.items_.reserve(view.size());
+    if (view.slotted_)
     {
-        throw std::runtime_error("Couldn't read offset");
+        for (size_t i = 0; i < view.size(); i++)
+        {
+            clusteredIndexNode.add_row(view.row(i));
+        }
+        clusteredIndexNode.slots_ = std::move(view.slots_);
+        clusteredIndexNode.key_prefix_ = std::move(view.key_prefix_);
+        clusteredIndexNode.slotted_ = true;
     }
-    // --- read root page ---
-    std::vector<uint8_t> root(page_size);
-    in.read(reinterpret_cast<char *>(root.data()), root.size());
-    if (!in)
+    else
     {
-        throw std::runtime_error("Couldn't read root");
+        clusteredIndexNode.items_ = std::move(view.decoded_);
     }
+    return clusteredIndexNode;
+}
 
-    size_t off = 0;
-    uint32_t page_count = readU32(root, off);
-
-    // --- read page list ---
-    std::vector<uint32_t> page_list;
-    for (uint32_t i = 0; i < page_count; ++i)
+bool ClusteredIndexNodeView::is_node(dbone::storage::BufferPool &pool, uint32_t page_num)
+{
+    uint64_t end = pool.page_count();
+    if (page_num == 0 || page_num >= end)
     {
-        uint32_t pg = readU32(root, off);
-        page_list.push_back(pg);
+        return false;
     }
-    // --- assemble full payload ---
-    // header size = 4 + (page_count-1)*4
-    size_t header_size = 4u + 4u * (page_count > 0 ? (page_count) : 0);
-    if (header_size > page_size)
+    dbone::storage::BufferPool::PageRef page = pool.fetch(page_num);
+    std::span<const uint8_t> bytes(page.data(), pool.page_size());
+    size_t ref = 0;
+    uint32_t extra = readU32(bytes, ref);
+    if (4 + 4 * static_cast<size_t>(extra) + ClusteredIndexNode::NODE_HEADER_SIZE > bytes.size())
     {
-        throw std::runtime_error("Header size too large!");
+        return false;
     }
+    for (uint32_t i = 0; i < extra; i++)
+    {
+        uint32_t next = readU32(bytes, ref);
+        if (next == 0 || next >= end)
+        {
+            return false;
+        }
+    }
+    return readU32(bytes, ref) == ClusteredIndexNode::SLOTTED_MAGIC;
+}
 
-    std::vector<uint8_t> full_payload;
+ClusteredIndexNodeView ClusteredIndexNodeView::load(const std::string &db_path, uint32_t page_num, const TableSchema &schema, uint32_t page_size)
+{
+    ClusteredIndexNodeView view;
+    view.schema_ = &schema;
+    view.page_num_ = page_num;
+    view.key_column_ = primary_key_index(schema).value_or(0);
+
+    // --- Read clustered index page (through the shared page cache) ---
+    // Single-page nodes stay pinned in the cache while the view is alive.
+    std::shared_ptr<dbone::storage::BufferPool> pool = dbone::storage::BufferPool::shared(db_path, page_size);
+    view.chain_ = dbone::storage::read_page_chain(*pool, page_num);
+    std::span<const uint8_t> full_payload = view.chain_.bytes();
+    const std::vector<uint32_t> &page_list = view.chain_.pages();
 
-    // copy remainder of root page (after header)
-    if (header_size < root.size())
+    size_t ref = 0;
+    uint32_t first = readU32(full_payload, ref);
+    if (first == ClusteredIndexNode::SLOTTED_MAGIC)
     {
-        full_payload.insert(full_payload.end(),
-                            root.begin() + header_size, root.end());
+        // Slot positions are page-relative; the payload starts after the
+        // chain header of the root page.
+        size_t chain_header = 4 + 4 * page_list.size();
+        uint16_t nRows = readU16(full_payload, ref);
+        uint16_t flags = readU16(full_payload, ref);
+        view.pointers_.reserve(nRows + 1);
+        view.pointers_.push_back(readU32(full_payload, ref));
+        if (flags & ClusteredIndexNode::FLAG_LINKED)
+        {
+            view.linked_ = true;
+            view.prev_leaf_ = readU32(full_payload, ref);
+            view.next_leaf_ = readU32(full_payload, ref);
+        }
+        if (flags & ClusteredIndexNode::FLAG_PREFIX)
+        {
+            uint16_t length = readU16(full_payload, ref);
+            if (ref + length > full_payload.size())
+            {
+                throw std::runtime_error("ClusteredIndexNode::load: bad key prefix at page " + std::to_string(page_num));
+            }
+            view.key_prefix_.assign(reinterpret_cast<const char *>(full_payload.data() + ref), length);
+            ref += length;
+        }
+
+        view.slots_.reserve(nRows);
+        view.rows_.reserve(nRows);
+        view.keys_.reserve(nRows);
+        for (size_t i = 0; i < nRows; i++)
+        {
+            view.pointers_.push_back(readU32(full_payload, ref));
+            ClusteredIndexNode::Slot slot;
+            slot.page = readU16(full_payload, ref);
+            slot.offset = readU16(full_payload, ref);
+            slot.length = readU16(full_payload, ref);
+            slot.key = readU16(full_payload, ref);
+            if (slot.page > page_list.size() || size_t(slot.offset) + slot.length > page_size ||
+                (slot.page == 0 && slot.offset < chain_header) ||
+                (slot.key != ClusteredIndexNode::NO_KEY && slot.key >= slot.length))
+            {
+                throw std::runtime_error("ClusteredIndexNode::load: bad slot at page " + std::to_string(page_num));
+            }
+            view.slots_.push_back(slot);
+
+            size_t row_ref = size_t(slot.page) * page_size + slot.offset - chain_header;
+            view.rows_.push_back(row_ref);
+            view.keys_.push_back(slot.key == ClusteredIndexNode::NO_KEY ? DataRow::NO_KEY : row_ref + slot.key);
+        }
+        view.slotted_ = true;
+
+        if (schema.columns[view.key_column_]->type() == ColumnType::BIGINT &&
+            std::find(view.keys_.begin(), view.keys_.end(), DataRow::NO_KEY) == view.keys_.end())
+        {
+            view.int_keys_.reserve(nRows);
+            for (size_t key_ref : view.keys_)
+            {
+                view.int_keys_.push_back(readI64(full_payload, key_ref));
+            }
+            view.int_keyed_ = true;
+        }
+        return view;
     }
 
-    // load and append each page in the list
-    for (uint32_t pg : page_list)
+    if (first == ClusteredIndexNode::LINKED_MAGIC)
     {
-        uint64_t pg_off = static_cast<uint64_t>(pg) * page_size;
-        std::vector<uint8_t> buf(page_size);
+        view.linked_ = true;
+        view.prev_leaf_ = readU32(full_payload, ref);
+        view.next_leaf_ = readU32(full_payload, ref);
+        first = readU32(full_payload, ref);
+    }
+    uint32_t nRows = first;
+    view.pointers_.push_back(readU32(full_payload, ref));
+
+    for (size_t i = 0; i < nRows; i++)
+    {
+        view.rows_.push_back(ref);
+        view.keys_.push_back(DataRow::NO_KEY);
+        view.decoded_.push_back(DataRow::bits_to_row(full_payload, ref, schema));
+        view.pointers_.push_back(readU32(full_payload, ref));
+    }
 
-        in.seekg(pg_off, std::ios::beg);
-        if (!in)
+    if (schema.columns[view.key_column_]->type() == ColumnType::BIGINT)
+    {
+        view.int_keys_.reserve(nRows);
+        for (const DataRow &row : view.decoded_)
         {
-            throw std::runtime_error("Couldn't read each page");
+            view.int_keys_.push_back(static_cast<const BigIntType &>(row.get(view.key_column_)).value());
         }
+        view.int_keyed_ = true;
+    }
+
+    return view;
+}
 
-        in.read(reinterpret_cast<char *>(buf.data()), buf.size());
-        if (!in)
+int ClusteredIndexNodeView::compare_key(size_t i, const DataType &key) const
+{
+    if (int_keyed_)
+    {
+        if (auto p = dynamic_cast<const BigIntType *>(&key))
         {
-            throw std::runtime_error("Couldn't read each page 1");
+            return int_keys_[i] < p->value() ? -1 : (int_keys_[i] > p->value() ? 1 : 0);
         }
-
-        full_payload.insert(full_payload.end(), buf.begin(), buf.end());
+    }
+    if (!key_prefix_.empty())
+    {
+        // Settled by the prefix unless the probe starts with it
+        const std::string *probe = Column::key_chars(key);
+        if (probe != nullptr && keys_[i] != DataRow::NO_KEY)
+        {
+            std::string_view rest(*probe);
+            size_t shared = std::min(rest.size(), key_prefix_.size());
+            int c = std::string_view(key_prefix_).compare(0, shared, rest.substr(0, shared));
+            if (c == 0 && rest.size() < key_prefix_.size())
+                return 1;
+            if (c == 0)
+            {
+                size_t ref = keys_[i];
+                c = schema_->columns[key_column_]->read_suffix(chain_.bytes(), ref, key_prefix_.size()).compare(rest.substr(shared));
+            }
+            return c < 0 ? -1 : (c > 0 ? 1 : 0);
+        }
+    }
+    else if (keys_[i] != DataRow::NO_KEY)
+    {
+        return schema_->columns[key_column_]->compare_bits(chain_.bytes(), keys_[i], key);
     }
 
-    size_t ref = 0;
-    uint16_t nRows = readU32(full_payload, ref);
+    DataRow decoded;
+    if (decoded_.empty())
+    {
+        decoded = row(i);
+    }
+    const DataType &stored = (decoded_.empty() ? decoded : decoded_[i]).get(key_column_);
+    if (stored < key)
+        return -1;
+    return key < stored ? 1 : 0;
+}
 
-    ClusteredIndexNode clusteredIndexNode;
-    clusteredIndexNode.set_available_pages(page_list);
-    clusteredIndexNode.set_original_page(page_num);
-    clusteredIndexNode.add_pointer(readU32(full_payload, ref));
+size_t ClusteredIndexNodeView::lower_bound(const DataType &key) const
+{
+    if (int_keyed_)
+    {
+        if (auto p = dynamic_cast<const BigIntType *>(&key))
+        {
+            return dbone::lower_bound_i64(int_keys_.data(), int_keys_.size(), p->value());
+        }
+    }
 
-    for (size_t i = 0; i < nRows; i++)
+    size_t lo = 0;
+    size_t hi = rows_.size();
+    while (lo < hi)
     {
-        DataRow row = DataRow::bits_to_row(full_payload, ref, schema);
-        // row.print();
-        clusteredIndexNode.add_row(std::move(row));
-        clusteredIndexNode.add_pointer(readU32(full_payload, ref));
+        size_t mid = lo + (hi - lo) / 2;
+        if (compare_key(mid, key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    
-    return clusteredIndexNode;
+    return lo;
+}
+
+DataRow ClusteredIndexNodeView::row(size_t i) const
+{
+    size_t ref = rows_[i];
+    return DataRow::bits_to_row(chain_.bytes(), ref, *schema_, key_prefix_);
 }
 
 void ClusteredIndexNode::add_row_at(DataRow &&row, size_t position)
@@ -148,6 +304,18 @@ void ClusteredIndexNode::set_pointer_at(uint32_t page_pointer, size_t position)
     page_pointers_[position] = page_pointer;
 }
 
+void ClusteredIndexNode::set_leaf_links(uint32_t prev, uint32_t next)
+{
+    if (!linked_)
+    {
+        // The directory grows, so the next write lays the node out again
+        linked_ = true;
+        slotted_ = false;
+    }
+    prev_leaf_ = prev;
+    next_leaf_ = next;
+}
+
 // Set original page
 void ClusteredIndexNode::set_original_page(uint32_t page)
 {
@@ -172,10 +340,6 @@ void ClusteredIndexNode::set_available_pages(const std::vector<uint32_t> &pages)
 }
 
 // Set available pages
-void ClusteredIndexNode::set_extra_available_pages(const std::vector<uint32_t> &pages)
-{
-    extra_available_pages_ = pages;
-}
 
 std::vector<DataRow> &ClusteredIndexNode::get_items()
 {
@@ -192,6 +356,13 @@ BitBuffer ClusteredIndexNode::to_bits() const
 {
     BitBuffer buf;
 
+    if (linked_)
+    {
+        buf.putU32(LINKED_MAGIC);
+        buf.putU32(prev_leaf_);
+        buf.putU32(next_leaf_);
+    }
+
     // number of rows
     buf.putU32(static_cast<uint32_t>(items_.size()));
 
@@ -211,13 +382,6 @@ BitBuffer ClusteredIndexNode::to_bits() const
     return buf;
 }
 
-size_t num_pages_in_file(const std::string &path, size_t page_size)
-{
-    namespace fs = std::filesystem;
-    auto file_size = fs::file_size(path);
-    return file_size / page_size;
-}
-
 std::vector<uint32_t> ClusteredIndexNode::get_available_pages_index()
 {
     return available_pages_;
@@ -228,6 +392,118 @@ std::optional<uint32_t> ClusteredIndexNode::get_original_page()
     return original_page_;
 }
 
+uint16_t ClusteredIndexNode::slot_key(size_t key_offset)
+{
+    return key_offset < NO_KEY ? static_cast<uint16_t>(key_offset) : NO_KEY;
+}
+
+bool ClusteredIndexNode::plan_slots(const std::vector<size_t> &lengths, uint32_t page_size, size_t max_rows,
+                                    size_t node_header, std::vector<Slot> &slots, size_t &num_pages)
+{
+    if (page_size > 65536)
+        return false;
+
+    num_pages = 1;
+    while (true)
+    {
+        size_t header_size = 4 + 4 * (num_pages - 1) + node_header;
+        size_t directory_end = header_size + SLOT_SIZE * lengths.size();
+        if (directory_end > page_size)
+            return false;
+
+        // Keep room on the root for the directory of a full node, so rows
+        // added later do not force a rewrite; small pages get what is left
+        size_t reserved_end = header_size + SLOT_SIZE * std::max(lengths.size(), max_rows);
+        size_t root_floor = reserved_end <= page_size ? reserved_end : directory_end;
+
+        slots.clear();
+        std::vector<size_t> heap{page_size};
+        size_t page = 0;
+        for (size_t length : lengths)
+        {
+            if (length > page_size || length > 0xFFFF)
+                return false;
+            while (heap[page] < (page == 0 ? root_floor : 0) + length)
+            {
+                page++;
+                if (page == heap.size())
+                    heap.push_back(page_size);
+            }
+            heap[page] -= length;
+            slots.push_back({static_cast<uint16_t>(page), static_cast<uint16_t>(heap[page]), static_cast<uint16_t>(length), NO_KEY});
+        }
+
+        // A larger guess only costs header bytes, so fewer pages still fit
+        if (heap.size() <= num_pages)
+        {
+            num_pages = heap.size();
+            return true;
+        }
+        num_pages = heap.size();
+    }
+}
+
+void ClusteredIndexNode::write_directory(uint8_t *root, const std::vector<uint32_t> &pages) const
+{
+    BitBuffer header;
+    header.putU32(static_cast<uint32_t>(pages.size() - 1));
+    for (size_t i = 1; i < pages.size(); i++)
+    {
+        header.putU32(pages[i]);
+    }
+    header.putU32(SLOTTED_MAGIC);
+    header.putU16(static_cast<uint16_t>(items_.size()));
+    header.putU16((linked_ ? FLAG_LINKED : 0) | (key_prefix_.empty() ? 0 : FLAG_PREFIX));
+    header.putU32(page_pointers_[0]);
+    if (linked_)
+    {
+        header.putU32(prev_leaf_);
+        header.putU32(next_leaf_);
+    }
+    if (!key_prefix_.empty())
+    {
+        header.putU16(static_cast<uint16_t>(key_prefix_.size()));
+        for (char c : key_prefix_)
+        {
+            header.putU8(static_cast<uint8_t>(c));
+        }
+    }
+    for (size_t i = 0; i < slots_.size(); i++)
+    {
+        header.putU32(page_pointers_[i + 1]);
+        header.putU16(slots_[i].page);
+        header.putU16(slots_[i].offset);
+        header.putU16(slots_[i].length);
+        header.putU16(slots_[i].key);
+    }
+
+    const std::vector<uint8_t> &bytes = header.bytes();
+    std::memcpy(root, bytes.data(), bytes.size());
+}
+
+std::string ClusteredIndexNode::common_key_prefix() const
+{
+    if (items_.size() < 2)
+        return {};
+
+    std::string_view prefix;
+    for (size_t i = 0; i < items_.size(); i++)
+    {
+        std::optional<size_t> pk = items_[i].primaryKeyIndex();
+        const std::string *chars = pk ? Column::key_chars(items_[i].get(*pk)) : nullptr;
+        if (chars == nullptr)
+            return {};
+        if (i == 0)
+        {
+            prefix = *chars;
+            continue;
+        }
+        size_t shared = std::mismatch(prefix.begin(), prefix.end(), chars->begin(), chars->end()).first - prefix.begin();
+        prefix = prefix.substr(0, shared);
+    }
+    return std::string(prefix.substr(0, std::min<size_t>(prefix.size(), 0xFFFF)));
+}
+
 std::vector<uint32_t> ClusteredIndexNode::save(const std::string &db_path, const TableSchema &schema, uint32_t page_size, bool save)
 {
     if (!original_page_)
@@ -235,25 +511,51 @@ std::vector<uint32_t> ClusteredIndexNode::save(const std::string &db_path, const
         throw std::runtime_error("ClusteredIndexNode::save: original page not set");
     }
 
-    // Build payload of all rows
-    BitBuffer payload = to_bits();
-    const auto &data = payload.bytes();
+    // Serialize every row once, remembering where each one ends; keys
+    // lose the prefix they share, which the directory holds
+    std::string key_prefix = common_key_prefix();
+    BitBuffer rows;
+    std::vector<size_t> lengths;
+    std::vector<size_t> keys;
+    lengths.reserve(items_.size());
+    keys.reserve(items_.size());
+    for (const DataRow &row : items_)
+    {
+        size_t before = rows.bytes().size();
+        size_t key_offset;
+        row.to_bits(rows, key_offset, key_prefix.size());
+        lengths.push_back(rows.bytes().size() - before);
+        keys.push_back(key_offset);
+    }
 
-    // Start with a guess for number of pages
+    std::vector<Slot> layout;
     size_t num_pages_needed = 1;
-    while (true)
+    bool slotted = plan_slots(lengths, page_size, schema.min_length * 2 + 1, node_header_size(key_prefix), layout, num_pages_needed);
+
+    BitBuffer payload;
+    if (!slotted)
     {
-        // Header = 4B count + 4B for each extra page
-        size_t header_size = 4 + 4 * (num_pages_needed - 1);
-        size_t total_size = header_size + data.size();
+        payload = to_bits();
+        const auto &data = payload.bytes();
 
-        size_t new_num_pages = (total_size + page_size - 1) / page_size;
-        if (new_num_pages == num_pages_needed)
-            break;
-        num_pages_needed = new_num_pages;
+        // Start with a guess for number of pages
+        num_pages_needed = 1;
+        while (true)
+        {
+            // Header = 4B count + 4B for each extra page
+            size_t header_size = 4 + 4 * (num_pages_needed - 1);
+            size_t total_size = header_size + data.size();
+
+            size_t new_num_pages = (total_size + page_size - 1) / page_size;
+            if (new_num_pages == num_pages_needed)
+                break;
+            num_pages_needed = new_num_pages;
+        }
     }
 
-    // Build page allocation order
+    // Build page allocation order: the node's own pages first, then fresh
+    // ones from the free-space map (only when actually saving), grown in
+    // place behind the last page where possible
     std::vector<uint32_t> used_pages;
     used_pages.push_back(*original_page_);
     for (uint32_t p : available_pages_)
@@ -263,75 +565,228 @@ std::vector<uint32_t> ClusteredIndexNode::save(const std::string &db_path, const
         used_pages.push_back(p);
     }
 
-    if (used_pages.size() < num_pages_needed)
+    if (!save)
     {
-        bool reupload = false;
+        return used_pages;
+    }
 
-        available_pages availablePages = get_available_pages(db_path, *schema.available_pages_ref, page_size);
+    std::shared_ptr<dbone::storage::BufferPool> pool = dbone::storage::BufferPool::shared(db_path, page_size);
+    dbone::storage::FreeSpaceMap &fsm = pool->free_space(*schema.available_pages_ref);
+    fsm.extend_chain(used_pages, num_pages_needed);
 
-        for (size_t i = 0; i < extra_available_pages_.size(); i++)
+    std::vector<uint8_t> final_bytes;
+    if (slotted)
+    {
+        final_bytes.assign(num_pages_needed * size_t(page_size), 0);
+        slots_ = std::move(layout);
+        key_prefix_ = std::move(key_prefix);
+        for (size_t i = 0; i < slots_.size(); i++)
         {
-            if (used_pages.size() >= num_pages_needed)
-                break;
-            uint32_t p = availablePages.available_pages_pointers[i];
-            availablePages.available_pages_pointers.erase(availablePages.available_pages_pointers.begin() + i);
-            used_pages.push_back(p);
-            reupload = true;
+            slots_[i].key = slot_key(keys[i]);
+        }
+        write_directory(final_bytes.data(), used_pages);
+
+        const std::vector<uint8_t> &row_bytes = rows.bytes();
+        size_t start = 0;
+        for (const Slot &slot : slots_)
+        {
+            std::memcpy(final_bytes.data() + size_t(slot.page) * page_size + slot.offset, row_bytes.data() + start, slot.length);
+            start += slot.length;
         }
+    }
+    else
+    {
+        // Build the header in a temporary buffer
+        BitBuffer header;
+        header.putU32(static_cast<uint32_t>(used_pages.size() - 1));
+        for (size_t i = 1; i < used_pages.size(); i++)
+        {
+            header.putU32(used_pages[i]);
+        }
+
+        // Merge header + payload into a single stream of bytes
+        const auto &data = payload.bytes();
+        final_bytes = header.bytes();
+        final_bytes.insert(final_bytes.end(), data.begin(), data.end());
 
-        if (reupload)
+        // Pad to multiple of page_size
+        if (final_bytes.size() % page_size != 0)
         {
-            set_available_pages_db(db_path, availablePages, page_size);
+            size_t pad = page_size - (final_bytes.size() % page_size);
+            final_bytes.insert(final_bytes.end(), pad, 0);
         }
+        slots_.clear();
+        key_prefix_.clear();
     }
+    slotted_ = slotted;
 
-    size_t next_page = num_pages_in_file(db_path, page_size);
-    while (used_pages.size() < num_pages_needed)
+    // ---- Write pages, adjacent page ids coalesced into one pwritev ----
+    pool->write_pages(used_pages, final_bytes.data());
+
+    set_available_pages(std::vector<uint32_t>(used_pages.begin() + 1, used_pages.end()));
+    return used_pages;
+}
+
+void ClusteredIndexNode::save_row(const std::string &db_path, const TableSchema &schema, uint32_t page_size, size_t position)
+{
+    if (!slotted_ || slots_.size() + 1 != items_.size() || position >= items_.size())
     {
-        used_pages.push_back(next_page++);
+        save(db_path, schema, page_size);
+        return;
     }
 
-    // Build the header in a temporary buffer
-    BitBuffer header;
-    header.putU32(static_cast<uint32_t>(used_pages.size() - 1));
-    for (size_t i = 1; i < used_pages.size(); i++)
+    // A key outside the node's prefix means a new one, so a full rewrite
+    if (!key_prefix_.empty())
     {
-        header.putU32(used_pages[i]);
+        std::optional<size_t> pk = items_[position].primaryKeyIndex();
+        const std::string *chars = pk ? Column::key_chars(items_[position].get(*pk)) : nullptr;
+        if (chars == nullptr || !chars->starts_with(key_prefix_))
+        {
+            save(db_path, schema, page_size);
+            return;
+        }
     }
 
-    // Merge header + payload into a single stream of bytes
-    std::vector<uint8_t> final_bytes = header.bytes();
-    final_bytes.insert(final_bytes.end(), data.begin(), data.end());
+    BitBuffer row;
+    size_t key_offset;
+    items_[position].to_bits(row, key_offset, key_prefix_.size());
+    size_t length = row.bytes().size();
+
+    std::vector<uint32_t> pages;
+    pages.push_back(*original_page_);
+    pages.insert(pages.end(), available_pages_.begin(), available_pages_.end());
 
-    // Pad to multiple of page_size
-    if (final_bytes.size() % page_size != 0)
+    std::vector<size_t> heap(pages.size(), page_size);
+    for (const Slot &slot : slots_)
     {
-        size_t pad = page_size - (final_bytes.size() % page_size);
-        final_bytes.insert(final_bytes.end(), pad, 0);
+        heap[slot.page] = std::min<size_t>(heap[slot.page], slot.offset);
     }
 
-    // ---- Write each page individually ----
-    if (save)
+    size_t header_size = 4 + 4 * (pages.size() - 1) + node_header_size(key_prefix_);
+    size_t directory_end = header_size + SLOT_SIZE * items_.size();
+    size_t reserved_end = header_size + SLOT_SIZE * std::max<size_t>(items_.size(), schema.min_length * 2 + 1);
+    if (length > 0xFFFF || length > page_size || directory_end > heap[0])
     {
-        std::fstream out(db_path, std::ios::in | std::ios::out | std::ios::binary);
-        if (!out)
-            throw std::runtime_error("Failed to open database file for writing");
+        save(db_path, schema, page_size);
+        return;
+    }
 
-        for (size_t i = 0; i < used_pages.size(); i++)
+    // Overflow pages first, then the root as long as that leaves the
+    // directory its room, then one more page behind the node
+    size_t target = pages.size();
+    for (size_t k = 1; k < pages.size(); k++)
+    {
+        if (heap[k] >= length)
         {
-            uint64_t offset = static_cast<uint64_t>(used_pages[i]) * page_size;
-            out.seekp(offset, std::ios::beg);
-            out.write(reinterpret_cast<const char *>(&final_bytes[i * page_size]), page_size);
-
-            if (!out)
-            {
-                throw std::runtime_error("Failed to write page " + std::to_string(used_pages[i]));
-            }
+            target = k;
+            break;
+        }
+    }
+    if (target == pages.size() && heap[0] >= std::max(reserved_end, directory_end) + length)
+    {
+        target = 0;
+    }
+    std::shared_ptr<dbone::storage::BufferPool> pool = dbone::storage::BufferPool::shared(db_path, page_size);
+    bool grown = false;
+    if (target == pages.size())
+    {
+        if (directory_end + 4 > heap[0] || pages.size() >= 0xFFFF)
+        {
+            save(db_path, schema, page_size);
+            return;
         }
-        out.flush();
+        dbone::storage::FreeSpaceMap &fsm = pool->free_space(*schema.available_pages_ref);
+        fsm.extend_chain(pages, pages.size() + 1);
+        heap.push_back(page_size);
+        grown = true;
     }
 
-    return used_pages;
+    slots_.insert(slots_.begin() + position,
+                  {static_cast<uint16_t>(target), static_cast<uint16_t>(heap[target] - length), static_cast<uint16_t>(length),
+                   slot_key(key_offset)});
+
+    // Root image (directory) plus the page the row lands on
+    std::vector<uint32_t> touched{pages[0]};
+    if (target != 0)
+        touched.push_back(pages[target]);
+    std::vector<uint8_t> images(touched.size() * size_t(page_size), 0);
+    pool->read_page(pages[0], images.data());
+    if (target != 0 && !grown)
+        pool->read_page(pages[target], images.data() + page_size);
+
+    uint8_t *dst = images.data() + (target != 0 ? page_size : 0);
+    std::memcpy(dst + slots_[position].offset, row.bytes().data(), length);
+    write_directory(images.data(), pages);
+
+    pool->write_pages(touched, images.data());
+
+    if (grown)
+    {
+        set_available_pages(std::vector<uint32_t>(pages.begin() + 1, pages.end()));
+    }
+}
+
+void ClusteredIndexNode::save_replaced(const std::string &db_path, const TableSchema &schema, uint32_t page_size, size_t position)
+{
+    if (!slotted_ || slots_.size() != items_.size() || position >= items_.size())
+    {
+        save(db_path, schema, page_size);
+        return;
+    }
+
+    // The key is unchanged, so it still starts with the node's prefix
+    BitBuffer row;
+    size_t key_offset;
+    items_[position].to_bits(row, key_offset, key_prefix_.size());
+    size_t length = row.bytes().size();
+    if (length > slots_[position].length)
+    {
+        // The old bytes are left as a gap until the next full save()
+        slots_.erase(slots_.begin() + position);
+        save_row(db_path, schema, page_size, position);
+        return;
+    }
+
+    std::vector<uint32_t> pages;
+    pages.push_back(*original_page_);
+    pages.insert(pages.end(), available_pages_.begin(), available_pages_.end());
+
+    Slot &slot = slots_[position];
+    slot.length = static_cast<uint16_t>(length);
+    slot.key = slot_key(key_offset);
+
+    std::vector<uint32_t> touched{pages[0]};
+    if (slot.page != 0)
+        touched.push_back(pages[slot.page]);
+    std::shared_ptr<dbone::storage::BufferPool> pool = dbone::storage::BufferPool::shared(db_path, page_size);
+    std::vector<uint8_t> images(touched.size() * size_t(page_size), 0);
+    for (size_t k = 0; k < touched.size(); k++)
+        pool->read_page(touched[k], images.data() + k * page_size);
+
+    uint8_t *dst = images.data() + (slot.page != 0 ? page_size : 0);
+    std::memcpy(dst + slot.offset, row.bytes().data(), length);
+    write_directory(images.data(), pages);
+
+    pool->write_pages(touched, images.data());
+}
+
+void ClusteredIndexNode::save_links(const std::string &db_path, const TableSchema &schema, uint32_t page_size)
+{
+    if (!slotted_ || slots_.size() != items_.size())
+    {
+        save(db_path, schema, page_size);
+        return;
+    }
+
+    std::vector<uint32_t> pages;
+    pages.push_back(*original_page_);
+    pages.insert(pages.end(), available_pages_.begin(), available_pages_.end());
+
+    std::shared_ptr<dbone::storage::BufferPool> pool = dbone::storage::BufferPool::shared(db_path, page_size);
+    std::vector<uint8_t> image(page_size);
+    pool->read_page(pages[0], image.data());
+    write_directory(image.data(), pages);
+    pool->write_page(pages[0], image.data());
 }
 
 void ClusteredIndexNode::print() const
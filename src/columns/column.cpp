@@ -1,5 +1,8 @@
 #include "dbone/columns/column.hpp"
+#include "dbone/serialize.hpp"
+#include <cmath>
 #include <optional>
+#include <string_view>
 
 // ---------- Column ----------
 Column::Column(std::string name,
@@ -7,27 +10,102 @@ Column::Column(std::string name,
                bool primaryKey,
                bool unique,
                bool indexed,
-               std::unique_ptr<DataType> defaultVal)
+               std::unique_ptr<DataType> defaultVal,
+               bool included)
     : name_(std::move(name)),
       nullable_(nullable),
       primaryKey_(primaryKey),
       unique_(unique),
       indexed_(indexed),
+      included_(included),
       defaultVal_(std::move(defaultVal)) {}
 
+int Column::compare_bits(std::span<const uint8_t> payload, size_t ref, const DataType &value) const
+{
+    std::unique_ptr<DataType> stored = from_bits(payload, ref);
+    if (*stored < value)
+        return -1;
+    return value < *stored ? 1 : 0;
+}
+
+const std::string *Column::key_chars(const DataType &value)
+{
+    if (auto p = dynamic_cast<const CharType *>(&value))
+        return &p->value();
+    if (auto p = dynamic_cast<const VarCharType *>(&value))
+        return &p->value();
+    return nullptr;
+}
+
+void Column::suffix_to_bits(BitBuffer &buf, const DataType &value, size_t prefix_len)
+{
+    // A CHAR suffix has a known length; a VARCHAR one keeps its length field
+    if (auto p = dynamic_cast<const CharType *>(&value))
+    {
+        for (size_t i = prefix_len; i < p->value().size(); i++)
+            buf.putU8(static_cast<uint8_t>(p->value()[i]));
+        return;
+    }
+    if (auto p = dynamic_cast<const VarCharType *>(&value))
+    {
+        VarCharType(p->value().substr(prefix_len), p->max_length()).to_bits(buf);
+        return;
+    }
+    throw std::runtime_error("suffix_to_bits: " + value.type_name() + " keys are not prefix compressed");
+}
+
+std::string_view Column::read_suffix(std::span<const uint8_t>, size_t &, size_t) const
+{
+    throw std::runtime_error("read_suffix: column " + name_ + " is not prefix compressed");
+}
+
+std::unique_ptr<DataType> Column::from_suffix_bits(std::span<const uint8_t>, size_t &, std::string_view) const
+{
+    throw std::runtime_error("from_suffix_bits: column " + name_ + " is not prefix compressed");
+}
+
+// Bytes in front of a VARCHAR value holding its length, as in VarCharType::to_bits
+static int varchar_len_bytes(uint32_t max_length)
+{
+    int bits = static_cast<int>(std::ceil(std::log2(max_length + 1)));
+    return (bits + 7) / 8;
+}
+
+// The length bytes at ref of payload, checked against the payload
+static std::string_view read_chars(std::span<const uint8_t> payload, size_t &ref, size_t length)
+{
+    if (ref + length > payload.size())
+        throw std::runtime_error("read_suffix: out of bounds at off=" + std::to_string(ref));
+    std::string_view chars(reinterpret_cast<const char *>(payload.data() + ref), length);
+    ref += length;
+    return chars;
+}
+
+// Three-way compare of stored bytes with a string, ordered like std::string
+static int compare_chars(std::span<const uint8_t> payload, size_t ref, size_t length, const std::string &value)
+{
+    if (ref + length > payload.size())
+        throw std::runtime_error("compare_bits: out of bounds at off=" + std::to_string(ref));
+    std::string_view stored(reinterpret_cast<const char *>(payload.data() + ref), length);
+    int c = stored.compare(value);
+    return c < 0 ? -1 : (c > 0 ? 1 : 0);
+}
+
 // ---------- BigIntColumn ----------
 BigIntColumn::BigIntColumn(std::string name,
                            bool nullable,
                            bool primaryKey,
                            bool unique,
                            bool indexed,
-                           int64_t defaultVal)
+                           int64_t defaultVal,
+                           bool included)
     : Column(std::move(name),
              nullable,
              primaryKey,
              unique,
              indexed,
-             std::make_unique<BigIntType>(defaultVal)) {}
+             std::make_unique<BigIntType>(defaultVal),
+             included) {}
 
 void BigIntColumn::to_bits(BitBuffer &buf) const
 {
@@ -42,6 +120,8 @@ void BigIntColumn::to_bits(BitBuffer &buf) const
         packed |= (1u << 5);
     if (indexed_)
         packed |= (1u << 4);
+    if (included_)
+        packed |= (1u << 3); // type ids fit in the low three bits
     packed |= static_cast<uint8_t>(ColumnType::BIGINT);
     buf.putU8(packed);
 
@@ -53,11 +133,20 @@ std::unique_ptr<DataType> BigIntColumn::parse(const std::string &raw) const
     return BigIntType::parse(raw);
 }
 
-std::unique_ptr<DataType> BigIntColumn::from_bits(const std::vector<uint8_t> &payload, size_t &ref) const
+std::unique_ptr<DataType> BigIntColumn::from_bits(std::span<const uint8_t> payload, size_t &ref) const
 {
     return std::make_unique<BigIntType>(BigIntType::from_bits(payload, ref));
 }
 
+int BigIntColumn::compare_bits(std::span<const uint8_t> payload, size_t ref, const DataType &value) const
+{
+    auto p = dynamic_cast<const BigIntType *>(&value);
+    if (!p)
+        return Column::compare_bits(payload, ref, value);
+    int64_t stored = readI64(payload, ref);
+    return stored < p->value() ? -1 : (stored > p->value() ? 1 : 0);
+}
+
 // ---------- CharColumn ----------
 CharColumn::CharColumn(std::string name,
                        uint32_t length,
@@ -65,13 +154,15 @@ CharColumn::CharColumn(std::string name,
                        bool primaryKey,
                        bool unique,
                        bool indexed,
-                       std::string defaultVal)
+                       std::string defaultVal,
+                       bool included)
     : Column(std::move(name),
              nullable,
              primaryKey,
              unique,
              indexed,
-             std::make_unique<CharType>(defaultVal, length)),
+             std::make_unique<CharType>(defaultVal, length),
+             included),
       length_(length) {}
 
 void CharColumn::to_bits(BitBuffer &buf) const
@@ -87,6 +178,8 @@ void CharColumn::to_bits(BitBuffer &buf) const
         packed |= (1u << 5);
     if (indexed_)
         packed |= (1u << 4);
+    if (included_)
+        packed |= (1u << 3); // type ids fit in the low three bits
     packed |= static_cast<uint8_t>(ColumnType::CHAR);
     buf.putU8(packed);
 
@@ -100,11 +193,33 @@ std::unique_ptr<DataType> CharColumn::parse(const std::string &raw) const
     return CharType::parse(raw, length_);
 }
 
-std::unique_ptr<DataType> CharColumn::from_bits(const std::vector<uint8_t> &payload, size_t &ref) const
+std::unique_ptr<DataType> CharColumn::from_bits(std::span<const uint8_t> payload, size_t &ref) const
 {
     return std::make_unique<CharType>(CharType::from_bits(payload, ref, length_));
 }
 
+int CharColumn::compare_bits(std::span<const uint8_t> payload, size_t ref, const DataType &value) const
+{
+    auto p = dynamic_cast<const CharType *>(&value);
+    if (!p)
+        return Column::compare_bits(payload, ref, value);
+    return compare_chars(payload, ref, length_, p->value());
+}
+
+std::string_view CharColumn::read_suffix(std::span<const uint8_t> payload, size_t &ref, size_t prefix_len) const
+{
+    if (prefix_len > length_)
+        throw std::runtime_error("CharColumn::read_suffix: prefix longer than the column");
+    return read_chars(payload, ref, length_ - prefix_len);
+}
+
+std::unique_ptr<DataType> CharColumn::from_suffix_bits(std::span<const uint8_t> payload, size_t &ref, std::string_view prefix) const
+{
+    std::string value(prefix);
+    value += read_suffix(payload, ref, prefix.size());
+    return std::make_unique<CharType>(std::move(value), length_);
+}
+
 // ---------- VarCharColumn ----------
 VarCharColumn::VarCharColumn(std::string name,
                        uint32_t max_length,
@@ -112,13 +227,15 @@ VarCharColumn::VarCharColumn(std::string name,
                        bool primaryKey,
                        bool unique,
                        bool indexed,
-                       std::string defaultVal)
+                       std::string defaultVal,
+                       bool included)
     : Column(std::move(name),
              nullable,
              primaryKey,
              unique,
              indexed,
-             std::make_unique<VarCharType>(defaultVal, max_length)),
+             std::make_unique<VarCharType>(defaultVal, max_length),
+             included),
       max_length_(max_length) {}
 
 void VarCharColumn::to_bits(BitBuffer &buf) const
@@ -134,6 +251,8 @@ void VarCharColumn::to_bits(BitBuffer &buf) const
         packed |= (1u << 5);
     if (indexed_)
         packed |= (1u << 4);
+    if (included_)
+        packed |= (1u << 3); // type ids fit in the low three bits
     packed |= static_cast<uint8_t>(ColumnType::VARCHAR);
     buf.putU8(packed);
 
@@ -147,7 +266,42 @@ std::unique_ptr<DataType> VarCharColumn::parse(const std::string &raw) const
     return VarCharType::parse(raw, max_length_);
 }
 
-std::unique_ptr<DataType> VarCharColumn::from_bits(const std::vector<uint8_t> &payload, size_t &ref) const
+std::unique_ptr<DataType> VarCharColumn::from_bits(std::span<const uint8_t> payload, size_t &ref) const
 {
     return std::make_unique<VarCharType>(VarCharType::from_bits(payload, ref, max_length_));
 }
+
+int VarCharColumn::compare_bits(std::span<const uint8_t> payload, size_t ref, const DataType &value) const
+{
+    auto p = dynamic_cast<const VarCharType *>(&value);
+    if (!p)
+        return Column::compare_bits(payload, ref, value);
+
+    int len_bytes = varchar_len_bytes(max_length_);
+    uint32_t length = 0;
+    for (int i = 0; i < len_bytes; i++)
+    {
+        length = (length << 8) | readU8(payload, ref);
+    }
+    return compare_chars(payload, ref, length, p->value());
+}
+
+std::string_view VarCharColumn::read_suffix(std::span<const uint8_t> payload, size_t &ref, size_t prefix_len) const
+{
+    int len_bytes = varchar_len_bytes(max_length_);
+    uint32_t length = 0;
+    for (int i = 0; i < len_bytes; i++)
+    {
+        length = (length << 8) | readU8(payload, ref);
+    }
+    if (prefix_len + length > max_length_)
+        throw std::runtime_error("VarCharColumn::read_suffix: length > max_length");
+    return read_chars(payload, ref, length);
+}
+
+std::unique_ptr<DataType> VarCharColumn::from_suffix_bits(std::span<const uint8_t> payload, size_t &ref, std::string_view prefix) const
+{
+    std::string value(prefix);
+    value += read_suffix(payload, ref, prefix.size());
+    return std::make_unique<VarCharType>(std::move(value), max_length_);
+}
@@ -1,6 +1,7 @@
 #include "dbone/columns/dataTypes.hpp"
 #include "dbone/serialize.hpp"
 #include <stdexcept>
+#include <cmath>
 
 // ================= BigIntType =================
 BigIntType::BigIntType(int64_t v) : value_(v) {}
@@ -14,7 +15,7 @@ void BigIntType::to_bits(BitBuffer &buf) const
     }
 }
 
-BigIntType BigIntType::from_bits(const std::vector<uint8_t> &payload, size_t &ref)
+BigIntType BigIntType::from_bits(std::span<const uint8_t> payload, size_t &ref)
 {
     int64_t v = readI64(payload, ref);
     return BigIntType(v);
@@ -72,7 +73,7 @@ void CharType::to_bits(BitBuffer &buf) const
     }
 }
 
-CharType CharType::from_bits(const std::vector<uint8_t> &payload, size_t &ref, uint32_t length)
+CharType CharType::from_bits(std::span<const uint8_t> payload, size_t &ref, uint32_t length)
 {
     std::string s;
     s.reserve(length);
@@ -149,7 +150,7 @@ void VarCharType::to_bits(BitBuffer &buf) const
     }
 }
 
-VarCharType VarCharType::from_bits(const std::vector<uint8_t> &payload, size_t &ref, uint32_t max_length)
+VarCharType VarCharType::from_bits(std::span<const uint8_t> payload, size_t &ref, uint32_t max_length)
 {
     // Determine how many bytes the length is stored in
     int bits = static_cast<int>(std::ceil(std::log2(max_length + 1)));
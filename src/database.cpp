@@ -0,0 +1,62 @@
+#include "dbone/database.hpp"
+
+namespace dbone
+{
+
+    Database Database::open(const std::string &db_path, uint32_t page_size,
+                            const storage::BufferPool::Options &options)
+    {
+        Database db;
+        db.path_ = db_path;
+        db.page_size_ = page_size;
+        db.pool_ = storage::BufferPool::shared(db_path, page_size, options);
+        db.schema_ = read_schema(db_path, page_size);
+        return db;
+    }
+
+    insert::ValidationResult Database::insert(const insert::Row &row)
+    {
+        return insert::insert(path_, schema_, row, page_size_);
+    }
+
+    insert::ValidationResult Database::bulk_load(const insert::RowSource &rows, double fill_factor)
+    {
+        return insert::bulk_load(path_, schema_, rows, fill_factor, page_size_);
+    }
+
+    insert::ValidationResult Database::insert_batch(std::span<const insert::Row> rows)
+    {
+        return insert::insert_batch(path_, schema_, rows, page_size_);
+    }
+
+    insert::UpdateResult Database::update(const DataType &primaryKey, const insert::Row &changes)
+    {
+        return insert::update(path_, schema_, primaryKey, changes, page_size_);
+    }
+
+    insert::UpdateResult Database::upsert(const insert::Row &row)
+    {
+        return insert::upsert(path_, schema_, row, page_size_);
+    }
+
+    remove::RemoveResult Database::remove(const std::vector<std::unique_ptr<DataType>> &primaryKeys)
+    {
+        return remove::remove(path_, schema_, primaryKeys, page_size_);
+    }
+
+    SearchResult Database::searchItem(const std::vector<SearchParam> &queries)
+    {
+        return search::searchItem(path_, schema_, queries, page_size_);
+    }
+
+    SearchResult Database::searchItem(const std::vector<SearchParam> &queries, const std::vector<std::string> &columns)
+    {
+        return search::searchItem(path_, schema_, queries, columns, page_size_);
+    }
+
+    SearchResult Database::searchPrimaryKeys(std::vector<std::unique_ptr<DataType>> &primaryKeys)
+    {
+        return search::searchPrimaryKeys(path_, schema_, primaryKeys, page_size_);
+    }
+
+} // namespace dbone
@@ -0,0 +1,296 @@
+#include "dbone/free_space_map.hpp"
+#include "dbone/buffer_pool.hpp"
+#include "dbone/serialize.hpp"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+namespace dbone::storage
+{
+
+    FreeSpaceMap::FreeSpaceMap(BufferPool &pool, uint32_t root_page)
+        : pool_(pool), root_page_(root_page), words_per_page_(pool.page_size() / 8)
+    {
+        if (pool.page_size() % 8 != 0)
+        {
+            throw std::runtime_error("FreeSpaceMap: page size must be a multiple of 8");
+        }
+
+        BufferPool::PageRef root = pool_.fetch(root_page_);
+        std::span<const uint8_t> header(root.data(), pool_.page_size());
+        size_t off = 0;
+        uint32_t count = readU32(header, off);
+        if (4u + 4u * static_cast<uint64_t>(count) > pool_.page_size())
+        {
+            throw std::runtime_error("FreeSpaceMap: corrupt root page " + std::to_string(root_page_));
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bitmap_pages_.push_back(readU32(header, off));
+        }
+        root.reset();
+
+        words_.assign(bitmap_pages_.size() * words_per_page_, 0);
+        for (size_t k = 0; k < bitmap_pages_.size(); k++)
+        {
+            BufferPool::PageRef page = pool_.fetch(bitmap_pages_[k]);
+            const uint8_t *src = page.data();
+            for (size_t w = 0; w < words_per_page_; w++)
+            {
+                uint64_t word = 0;
+                for (int b = 0; b < 8; b++)
+                    word |= static_cast<uint64_t>(src[w * 8 + b]) << (8 * b);
+                words_[k * words_per_page_ + w] = word;
+                free_count_ += static_cast<uint64_t>(std::popcount(word));
+            }
+        }
+        dirty_.assign(bitmap_pages_.size(), false);
+    }
+
+    uint32_t FreeSpaceMap::allocate()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return allocate_locked();
+    }
+
+    uint32_t FreeSpaceMap::allocate_locked()
+    {
+        for (size_t w = hint_; w < words_.size(); w++)
+        {
+            if (words_[w] != 0)
+            {
+                hint_ = w;
+                uint64_t page = w * 64 + static_cast<uint64_t>(std::countr_zero(words_[w]));
+                mark_used(page, 1);
+                return static_cast<uint32_t>(page);
+            }
+        }
+        hint_ = words_.size();
+        return pool_.allocate_pages(1);
+    }
+
+    uint32_t FreeSpaceMap::allocate_run(uint32_t n)
+    {
+        if (n == 0)
+        {
+            throw std::runtime_error("FreeSpaceMap: empty run requested");
+        }
+
+        std::lock_guard<std::mutex> lock(mu_);
+        if (n == 1)
+            return allocate_locked();
+        return allocate_run_locked(n);
+    }
+
+    uint32_t FreeSpaceMap::allocate_run_locked(uint32_t n)
+    {
+        // Whole words are skipped (all used) or swallowed (all free) at once.
+        uint64_t total = static_cast<uint64_t>(words_.size()) * 64;
+        uint64_t run_start = 0;
+        uint64_t run_len = 0;
+        uint64_t p = static_cast<uint64_t>(hint_) * 64;
+        while (p < total && run_len < n)
+        {
+            uint64_t word = words_[p / 64];
+            if (p % 64 == 0 && word == 0)
+            {
+                run_len = 0;
+                p += 64;
+                continue;
+            }
+            if (p % 64 == 0 && word == ~0ull)
+            {
+                if (run_len == 0)
+                    run_start = p;
+                run_len += 64;
+                p += 64;
+                continue;
+            }
+            if ((word >> (p % 64)) & 1u)
+            {
+                if (run_len == 0)
+                    run_start = p;
+                run_len++;
+            }
+            else
+            {
+                run_len = 0;
+            }
+            p++;
+        }
+
+        if (run_len >= n)
+        {
+            mark_used(run_start, n);
+            return static_cast<uint32_t>(run_start);
+        }
+        return pool_.allocate_pages(n);
+    }
+
+    bool FreeSpaceMap::allocate_at(uint32_t page)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return allocate_at_locked(page);
+    }
+
+    void FreeSpaceMap::extend_chain(std::vector<uint32_t> &pages, size_t n)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        while (!pages.empty() && pages.size() < n && pages.back() < UINT32_MAX &&
+               allocate_at_locked(pages.back() + 1))
+        {
+            pages.push_back(pages.back() + 1);
+        }
+        if (pages.size() >= n)
+            return;
+
+        uint32_t missing = static_cast<uint32_t>(n - pages.size());
+        uint32_t first = missing == 1 ? allocate_locked() : allocate_run_locked(missing);
+        for (uint32_t i = 0; i < missing; i++)
+        {
+            pages.push_back(first + i);
+        }
+    }
+
+    bool FreeSpaceMap::allocate_at_locked(uint32_t page)
+    {
+        uint64_t end = pool_.page_count();
+        if (page < end)
+        {
+            size_t w = page / 64;
+            if (w >= words_.size() || !((words_[w] >> (page % 64)) & 1u))
+                return false;
+            mark_used(page, 1);
+            return true;
+        }
+
+        // Past the end: anything skipped over becomes free space rather
+        // than pages nobody owns.
+        uint32_t first = pool_.allocate_pages(static_cast<uint32_t>(page + 1 - end));
+        for (uint32_t skipped = first; skipped < page; skipped++)
+        {
+            mark_free(skipped);
+        }
+        return true;
+    }
+
+    void FreeSpaceMap::free_page(uint32_t page)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        mark_free(page);
+    }
+
+    bool FreeSpaceMap::is_free(uint32_t page) const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        size_t w = page / 64;
+        return w < words_.size() && ((words_[w] >> (page % 64)) & 1u);
+    }
+
+    uint64_t FreeSpaceMap::free_count() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return free_count_;
+    }
+
+    void FreeSpaceMap::flush()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+
+        // The bitmap's own pages come out of the map, which can only clear
+        // bits, so the number of pages needed does not move under us.
+        size_t needed = (words_.size() + words_per_page_ - 1) / words_per_page_;
+        while (bitmap_pages_.size() < needed)
+        {
+            bitmap_pages_.push_back(allocate_locked());
+            root_dirty_ = true;
+        }
+        if (4u + 4u * static_cast<uint64_t>(bitmap_pages_.size()) > pool_.page_size())
+        {
+            throw std::runtime_error("FreeSpaceMap: table too large for one bitmap root page");
+        }
+        dirty_.resize(bitmap_pages_.size(), true);
+
+        const size_t page_size = pool_.page_size();
+        std::vector<uint32_t> ids;
+        std::vector<uint8_t> bytes;
+        for (size_t k = 0; k < bitmap_pages_.size(); k++)
+        {
+            if (!dirty_[k])
+                continue;
+            ids.push_back(bitmap_pages_[k]);
+            bytes.resize(bytes.size() + page_size, 0);
+            uint8_t *dst = bytes.data() + bytes.size() - page_size;
+            for (size_t w = 0; w < words_per_page_; w++)
+            {
+                size_t index = k * words_per_page_ + w;
+                uint64_t word = index < words_.size() ? words_[index] : 0;
+                for (int b = 0; b < 8; b++)
+                    dst[w * 8 + b] = static_cast<uint8_t>(word >> (8 * b));
+            }
+            dirty_[k] = false;
+        }
+        if (root_dirty_)
+        {
+            ids.push_back(root_page_);
+            bytes.resize(bytes.size() + page_size, 0);
+            uint8_t *dst = bytes.data() + bytes.size() - page_size;
+            size_t off = 0;
+            auto put = [&](uint32_t v)
+            {
+                for (int b = 0; b < 4; b++)
+                    dst[off++] = static_cast<uint8_t>(v >> (8 * b));
+            };
+            put(static_cast<uint32_t>(bitmap_pages_.size()));
+            for (uint32_t pg : bitmap_pages_)
+                put(pg);
+            root_dirty_ = false;
+        }
+
+        if (!ids.empty())
+        {
+            pool_.write_pages(ids, bytes.data());
+        }
+    }
+
+    void FreeSpaceMap::mark_used(uint64_t first, uint32_t n)
+    {
+        for (uint64_t page = first; page < first + n; page++)
+        {
+            size_t w = static_cast<size_t>(page / 64);
+            words_[w] &= ~(1ull << (page % 64));
+            mark_dirty(w);
+        }
+        free_count_ -= n;
+    }
+
+    void FreeSpaceMap::mark_free(uint32_t page)
+    {
+        size_t w = page / 64;
+        if (w >= words_.size())
+        {
+            words_.resize(w + 1, 0);
+        }
+        uint64_t bit = 1ull << (page % 64);
+        if (words_[w] & bit)
+        {
+            throw std::runtime_error("FreeSpaceMap: page " + std::to_string(page) + " freed twice");
+        }
+        words_[w] |= bit;
+        free_count_++;
+        hint_ = std::min(hint_, w);
+        mark_dirty(w);
+    }
+
+    void FreeSpaceMap::mark_dirty(size_t word)
+    {
+        size_t k = word / words_per_page_;
+        if (k >= dirty_.size())
+        {
+            dirty_.resize(k + 1, true);
+        }
+        dirty_[k] = true;
+    }
+
+} // namespace dbone::storage
@@ -3,11 +3,17 @@
 #include "dbone/storage.hpp"
 #include "dbone/serialize.hpp"
 #include "dbone/clustered_index_node.hpp"
+#include "dbone/buffer_pool.hpp"
+#include "dbone/key_search.hpp"
+#include "dbone/remove.hpp"
 #include <sstream>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
+#include <optional>
+#include <utility>
 #include <dbone/secondary_index_node.hpp>
 
 struct InsertIntoResult
@@ -61,10 +67,82 @@ namespace dbone::insert
         return {true, ""};
     }
 
+    // Split a full B+tree leaf into two linked leaves: the left half at
+    // left_page, with spare as its overflow pages, and the right half on a
+    // new page. The rows stay in the leaves; separator becomes the shortest
+    // key between the two halves. Returns the right page.
+    static uint32_t split_leaf(ClusteredIndexNode &leaf, uint32_t left_page, std::vector<uint32_t> spare, DataRow &separator, const TableSchema &schema, const std::string &db_path, uint32_t page_size)
+    {
+        storage::FreeSpaceMap &fsm = storage::BufferPool::shared(db_path, page_size)->free_space(*schema.available_pages_ref);
+        uint32_t right_page = fsm.allocate();
+
+        std::vector<DataRow> &rows = leaf.get_items();
+        ClusteredIndexNode left;
+        ClusteredIndexNode right;
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            ClusteredIndexNode &half = i < schema.min_length ? left : right;
+            half.add_row(std::move(rows[i]));
+            half.add_pointer(0);
+        }
+        left.add_pointer(0);
+        right.add_pointer(0);
+        separator = DataRow::separator(left.get_items().back(), right.get_items()[0]);
+
+        left.set_leaf_links(leaf.prev_leaf(), right_page);
+        left.set_original_page(left_page);
+        left.set_available_pages(spare);
+        std::vector<uint32_t> used = left.save(db_path, schema, page_size);
+        for (uint32_t page : spare)
+        {
+            if (std::find(used.begin(), used.end(), page) == used.end())
+            {
+                fsm.free_page(page);
+            }
+        }
+
+        right.set_leaf_links(left_page, leaf.next_leaf());
+        right.set_original_page(right_page);
+        right.save(db_path, schema, page_size);
+
+        if (leaf.next_leaf() != 0)
+        {
+            ClusteredIndexNode next = ClusteredIndexNode::load(db_path, leaf.next_leaf(), schema, page_size);
+            next.set_leaf_links(right_page, next.next_leaf());
+            next.save_links(db_path, schema, page_size);
+        }
+        return right_page;
+    }
+
     uint32_t split_root(uint32_t current_page_ref, ClusteredIndexNode &originalNode, const TableSchema &schema, const std::string &db_path, uint32_t page_size)
     {
+        storage::FreeSpaceMap &fsm = storage::BufferPool::shared(db_path, page_size)->free_space(*schema.available_pages_ref);
         std::vector<uint32_t> otherAvailablePages = originalNode.get_available_pages_index();
 
+        if (schema.bplus_tree && originalNode.get_page_pointers()[0] == 0)
+        {
+            // Both halves move to new pages; the root keeps its page and
+            // holds just the separator.
+            ClusteredIndexNode newRoot;
+            uint32_t left_page = fsm.allocate();
+            DataRow separator;
+            uint32_t right_page = split_leaf(originalNode, left_page, {}, separator, schema, db_path, page_size);
+            newRoot.add_row(std::move(separator));
+            newRoot.add_pointer(left_page);
+            newRoot.add_pointer(right_page);
+            newRoot.set_original_page(current_page_ref);
+            newRoot.set_available_pages(otherAvailablePages);
+            std::vector<uint32_t> used = newRoot.save(db_path, schema, page_size);
+            for (uint32_t page : otherAvailablePages)
+            {
+                if (std::find(used.begin(), used.end(), page) == used.end())
+                {
+                    fsm.free_page(page);
+                }
+            }
+            return current_page_ref;
+        }
+
         ClusteredIndexNode newRoot;
         newRoot.add_row(std::move(originalNode.get_items()[schema.min_length]));
         newRoot.add_pointer(0);
@@ -92,7 +170,7 @@ namespace dbone::insert
             page2.add_pointer(originalNode.get_page_pointers()[i + schema.min_length + 1]);
         }
         page1.add_pointer(originalNode.get_page_pointers()[schema.min_length]);
-        page2.add_pointer(originalNode.get_page_pointers()[schema.min_length * 2]);
+        page2.add_pointer(originalNode.get_page_pointers()[schema.min_length * 2 + 1]);
 
 
         uint32_t page1Ptr;
@@ -103,7 +181,7 @@ namespace dbone::insert
         }
         else
         {
-            page1Ptr = num_pages_in_file(db_path, page_size);
+            page1Ptr = fsm.allocate();
         }
         page1.set_original_page(page1Ptr);
         page1.set_available_pages(otherAvailablePages);
@@ -123,11 +201,22 @@ namespace dbone::insert
         }
         else
         {
-            page2Ptr = num_pages_in_file(db_path, page_size);
+            page2Ptr = fsm.allocate();
         }
         page2.set_original_page(page2Ptr);
         page2.set_available_pages(otherAvailablePages);
         std::vector<uint32_t> pagesUsed2 = page2.save(db_path, schema, page_size);
+        for (uint32_t page : pagesUsed2)
+        {
+            otherAvailablePages.erase(
+                std::remove(otherAvailablePages.begin(), otherAvailablePages.end(), page),
+                otherAvailablePages.end());
+        }
+        // Overflow pages of the old node that neither half needed.
+        for (uint32_t page : otherAvailablePages)
+        {
+            fsm.free_page(page);
+        }
 
         newRoot.clear_pointers();
         newRoot.add_pointer(page1Ptr);
@@ -137,57 +226,25 @@ namespace dbone::insert
         return current_page_ref;
     }
 
-    bool insert_data_row(const std::string &db_path, uint32_t page_num, DataRow &&row, uint32_t page1, uint32_t page2, uint32_t page_size, const TableSchema &schema)
+    // Split the full child at position of parent and move its middle row up
+    // into parent, which must have room for it. Both halves and parent are
+    // saved; parent's pointers at position and position + 1 are the halves.
+    // A B+tree leaf keeps its rows and a key-only copy goes up instead.
+    void split_node(ClusteredIndexNode &parent, size_t position, ClusteredIndexNode &originalNode, const TableSchema &schema, const std::string &db_path, uint32_t page_size)
     {
-        ClusteredIndexNode clusteredIndexNode = ClusteredIndexNode::load(db_path, page_num, schema, page_size);
-
-        if (clusteredIndexNode.get_items().size() >= schema.min_length * 2 + 1)
-        {
-            throw std::runtime_error("INSERT FAILED - FORCE INSERT BREAKS BOUNDS");
-        }
-        DataRow &&dataRow = std::move(row);
-        if (clusteredIndexNode.get_items().size() == 0)
-        {
-            clusteredIndexNode.add_row(std::move(dataRow));
-            clusteredIndexNode.add_pointer(static_cast<uint32_t>(0));
-        }
-        else
+        if (schema.bplus_tree && originalNode.get_page_pointers()[0] == 0)
         {
-            std::vector<DataRow> &rows = clusteredIndexNode.get_items();
-            bool added = false;
-            for (size_t i = 0; i < clusteredIndexNode.get_items().size(); i++)
-            {
-                // dataRow.get(*dataRow.primaryKeyIndex());
-                if (rows[i].get(*rows[i].primaryKeyIndex()) > dataRow.get(*dataRow.primaryKeyIndex()))
-                {
-                    clusteredIndexNode.add_row_at(std::move(dataRow), i);
-                    clusteredIndexNode.add_pointer_at(static_cast<uint32_t>(page1), i);
-                    clusteredIndexNode.set_pointer_at(static_cast<uint32_t>(page2), i + 1);
-                    added = true;
-                    break;
-                }
-                else if (rows[i].get(*rows[i].primaryKeyIndex()) == dataRow.get(*dataRow.primaryKeyIndex()))
-                {
-                    throw std::runtime_error(
-                        "Insert failed: primary key already exists (value = " +
-                        rows[i].get(*rows[i].primaryKeyIndex()).default_value_str() + ")");
-                }
-            }
-            if (!added)
-            {
-                clusteredIndexNode.add_row(std::move(dataRow));
-                clusteredIndexNode.set_pointer_at(page1, clusteredIndexNode.get_items().size() - 1);
-                clusteredIndexNode.add_pointer(page2);
-            }
+            uint32_t left_page = *originalNode.get_original_page();
+            DataRow separator;
+            uint32_t right_page = split_leaf(originalNode, left_page, originalNode.get_available_pages_index(), separator, schema, db_path, page_size);
+            parent.add_row_at(std::move(separator), position);
+            parent.add_pointer_at(left_page, position);
+            parent.set_pointer_at(right_page, position + 1);
+            parent.save_row(db_path, schema, page_size, position);
+            return;
         }
 
-        clusteredIndexNode.save(db_path, schema, page_size);
-
-        return true;
-    }
-
-    bool split_node(uint32_t above_page_ref, ClusteredIndexNode &originalNode, const TableSchema &schema, const std::string &db_path, uint32_t page_size)
-    {
+        storage::FreeSpaceMap &fsm = storage::BufferPool::shared(db_path, page_size)->free_space(*schema.available_pages_ref);
         std::vector<uint32_t> otherAvailablePages = originalNode.get_available_pages_index();
         otherAvailablePages.insert(otherAvailablePages.begin(), *originalNode.get_original_page());
 
@@ -203,7 +260,7 @@ namespace dbone::insert
             page2.add_pointer(originalNode.get_page_pointers()[i + schema.min_length + 1]);
         }
         page1.add_pointer(originalNode.get_page_pointers()[schema.min_length]);
-        page2.add_pointer(originalNode.get_page_pointers()[schema.min_length * 2]);
+        page2.add_pointer(originalNode.get_page_pointers()[schema.min_length * 2 + 1]);
 
         uint32_t page1Ptr;
         if (otherAvailablePages.size() > 0)
@@ -213,7 +270,7 @@ namespace dbone::insert
         }
         else
         {
-            page1Ptr = num_pages_in_file(db_path, page_size);
+            page1Ptr = fsm.allocate();
         }
         page1.set_original_page(page1Ptr);
         page1.set_available_pages(otherAvailablePages);
@@ -233,94 +290,288 @@ namespace dbone::insert
         }
         else
         {
-            page2Ptr = num_pages_in_file(db_path, page_size);
+            page2Ptr = fsm.allocate();
         }
         page2.set_original_page(page2Ptr);
         page2.set_available_pages(otherAvailablePages);
         std::vector<uint32_t> pagesUsed2 = page2.save(db_path, schema, page_size);
+        for (uint32_t page : pagesUsed2)
+        {
+            otherAvailablePages.erase(
+                std::remove(otherAvailablePages.begin(), otherAvailablePages.end(), page),
+                otherAvailablePages.end());
+        }
+        // Overflow pages of the old node that neither half needed.
+        for (uint32_t page : otherAvailablePages)
+        {
+            fsm.free_page(page);
+        }
 
 
-        insert_data_row(db_path, above_page_ref, std::move(rowPush), page1Ptr, page2Ptr, page_size, schema);
-
-        return true;
+        parent.add_row_at(std::move(rowPush), position);
+        parent.add_pointer_at(page1Ptr, position);
+        parent.set_pointer_at(page2Ptr, position + 1);
+        parent.save_row(db_path, schema, page_size, position);
     }
 
-    bool insertInto(const std::string &db_path, uint32_t page_num, const Row &row, uint32_t page_size, const TableSchema &schema, uint32_t previous_page_ref = 0)
+    // A row above every key in the table goes to the end of the rightmost
+    // leaf, reached through the right edge the pool has on record instead
+    // of a descent. A full leaf is not split in half: the row moves up to
+    // the lowest node on the edge with room and a new, empty right edge
+    // starts below it, so the nodes left behind stay full. In a B+tree the
+    // row starts a new leaf at the bottom of that edge and only its key
+    // moves up. Returns the page the row went to, or 0,
+    // having written nothing, when no edge is on record or the row does not
+    // sort after the last one.
+    static uint32_t append_right(const std::string &db_path, uint32_t root_page, DataRow &dataRow, const DataType &key, uint32_t page_size, const TableSchema &schema)
     {
-        ClusteredIndexNode clusteredIndexNode = ClusteredIndexNode::load(db_path, page_num, schema, page_size);
+        std::shared_ptr<storage::BufferPool> pool = storage::BufferPool::shared(db_path, page_size);
+        std::vector<uint32_t> edge = pool->right_edge(root_page);
+        if (edge.empty())
+        {
+            return 0;
+        }
+        const size_t max_rows = schema.min_length * 2 + 1;
+
+        // The largest key in the table is the last row of the lowest node on
+        // the edge that has rows; a new right edge starts out empty.
+        ClusteredIndexNodeView leaf = ClusteredIndexNodeView::load(db_path, edge.back(), schema, page_size);
+        bool above = false;
+        if (leaf.size() > 0)
+        {
+            above = leaf.compare_key(leaf.size() - 1, key) < 0;
+        }
+        else if (schema.bplus_tree)
+        {
+            // Only an empty table has an empty B+tree leaf on its edge
+            above = edge.size() == 1;
+        }
+        else
+        {
+            for (size_t i = edge.size() - 1; i-- > 0;)
+            {
+                ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, edge[i], schema, page_size);
+                if (node.size() > 0)
+                {
+                    above = node.compare_key(node.size() - 1, key) < 0;
+                    break;
+                }
+            }
+        }
+        if (!above)
+        {
+            return 0;
+        }
 
-        if (clusteredIndexNode.get_items().size() >= schema.min_length * 2 + 1)
+        if (leaf.size() < max_rows)
         {
-            if (previous_page_ref == 0)
+            ClusteredIndexNode node = ClusteredIndexNode::load(std::move(leaf));
+            size_t position = node.get_items().size();
+            node.add_row(std::move(dataRow));
+            node.add_pointer(static_cast<uint32_t>(0));
+            node.save_row(db_path, schema, page_size, position);
+            return edge.back();
+        }
+
+        // edge[level..] are full; edge[level - 1] takes the row, or with
+        // level == 0 the root is full too and the tree grows a level.
+        size_t level = edge.size() - 1;
+        std::optional<ClusteredIndexNode> host;
+        while (level > 0)
+        {
+            ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, edge[level - 1], schema, page_size);
+            if (node.size() < max_rows)
             {
-                uint32_t pointer = split_root(*clusteredIndexNode.get_original_page(), clusteredIndexNode, schema, db_path, page_size);
+                host = ClusteredIndexNode::load(std::move(node));
+                break;
             }
-            else
+            level--;
+        }
+
+        storage::FreeSpaceMap &fsm = pool->free_space(*schema.available_pages_ref);
+        // With level == 0 the root's rows move to this page
+        uint32_t moved = host ? 0 : fsm.allocate();
+        uint32_t oldLeaf = edge.size() == 1 && !host ? moved : edge.back();
+
+        std::vector<uint32_t> chain(edge.size() - level);
+        for (uint32_t &page : chain)
+        {
+            page = fsm.allocate();
+        }
+        uint32_t landed = schema.bplus_tree ? chain.back() : host ? edge[level - 1] : root_page;
+        DataRow up = schema.bplus_tree ? DataRow::separator(leaf.row(leaf.size() - 1), dataRow) : std::move(dataRow);
+        for (size_t i = 0; i < chain.size(); i++)
+        {
+            ClusteredIndexNode node;
+            if (schema.bplus_tree && i + 1 == chain.size())
             {
-                bool pointer = split_node(previous_page_ref, clusteredIndexNode, schema, db_path, page_size);
+                node.add_row(std::move(dataRow));
+                node.add_pointer(0);
+                node.set_leaf_links(oldLeaf, 0);
             }
-            return insertInto(db_path, *schema.clustered_page_ref, row, page_size, schema);
-            // return false;
-            // insertInto(db_path, pointer, row, page_size, schema);
+            node.add_pointer(i + 1 < chain.size() ? chain[i + 1] : 0);
+            node.set_original_page(chain[i]);
+            node.save(db_path, schema, page_size);
+        }
+        if (schema.bplus_tree && oldLeaf != moved)
+        {
+            ClusteredIndexNode node = ClusteredIndexNode::load(db_path, oldLeaf, schema, page_size);
+            node.set_leaf_links(node.prev_leaf(), chain.back());
+            node.save_links(db_path, schema, page_size);
         }
 
-        DataRow dataRow = DataRow::fromRow(row, schema);
-        if (clusteredIndexNode.get_items().size() == 0)
+        if (host)
         {
-            clusteredIndexNode.add_row(std::move(dataRow));
-            clusteredIndexNode.add_pointer(static_cast<uint32_t>(0));
+            size_t position = host->get_items().size();
+            host->add_row(std::move(up));
+            host->add_pointer(chain[0]);
+            host->save_row(db_path, schema, page_size, position);
+            edge.resize(level);
         }
         else
         {
-            std::vector<DataRow> &rows = clusteredIndexNode.get_items();
-            bool added = false;
-            for (size_t i = 0; i < clusteredIndexNode.get_items().size(); i++)
+            // The root keeps its page: move its rows to a new one and leave
+            // just the new row above the old root and the new edge.
+            ClusteredIndexNode oldRoot = ClusteredIndexNode::load(db_path, root_page, schema, page_size);
+            oldRoot.set_original_page(moved);
+            if (schema.bplus_tree && oldLeaf == moved)
+            {
+                oldRoot.set_leaf_links(0, chain.back());
+            }
+            oldRoot.save(db_path, schema, page_size);
+
+            ClusteredIndexNode newRoot;
+            newRoot.add_row(std::move(up));
+            newRoot.add_pointer(moved);
+            newRoot.add_pointer(chain[0]);
+            newRoot.set_original_page(root_page);
+            newRoot.save(db_path, schema, page_size);
+            edge.resize(1);
+        }
+        edge.insert(edge.end(), chain.begin(), chain.end());
+        pool->set_right_edge(root_page, std::move(edge));
+        return landed;
+    }
+
+    // Returns the page of the node the row was written to. With replaced
+    // given, a row already stored under the key is swapped for the new one
+    // where it lies and handed back in *replaced; without, such a key fails
+    // the insert.
+    uint32_t insertInto(const std::string &db_path, uint32_t page_num, const Row &row, uint32_t page_size, const TableSchema &schema, std::optional<DataRow> *replaced = nullptr)
+    {
+        DataRow dataRow = DataRow::fromRow(row, schema);
+        size_t pk = *dataRow.primaryKeyIndex();
+        const DataType &key = dataRow.get(pk);
+        const size_t max_rows = schema.min_length * 2 + 1;
+
+        if (uint32_t landed = append_right(db_path, page_num, dataRow, key, page_size, schema))
+        {
+            return landed;
+        }
+
+        // One pass from the root. A full node is split before the descent
+        // enters it, while its parent is still in hand, so the parent always
+        // has room for the row moved up and no node is visited twice. Nodes
+        // on the way down are only read through views; one is decoded only
+        // when it changes. A descent that stays on the right edge records it
+        // for append_right; a split on the edge forgets the old record.
+        std::shared_ptr<storage::BufferPool> pool = storage::BufferPool::shared(db_path, page_size);
+        std::vector<uint32_t> edge{page_num};
+        ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, page_num, schema, page_size);
+        if (node.size() >= max_rows)
+        {
+            pool->set_right_edge(page_num, {});
+            ClusteredIndexNode root = ClusteredIndexNode::load(std::move(node));
+            split_root(page_num, root, schema, db_path, page_size);
+            node = ClusteredIndexNodeView::load(db_path, page_num, schema, page_size);
+        }
+
+        while (true)
+        {
+            size_t position = node.lower_bound(key);
+            if (position < node.size() && node.compare_key(position, key) == 0)
             {
-                // dataRow.get(*dataRow.primaryKeyIndex());
-                if (rows[i].get(*rows[i].primaryKeyIndex()) > dataRow.get(*dataRow.primaryKeyIndex()))
+                // A B+tree separator equal to the key sends it right
+                if ((!schema.bplus_tree || node.pointer(0) == 0) && replaced)
                 {
-                    if (clusteredIndexNode.get_page_pointers()[0] == static_cast<uint32_t>(0))
-                    {
-                        clusteredIndexNode.add_row_at(std::move(dataRow), i);
-                        clusteredIndexNode.add_pointer_at(static_cast<uint32_t>(0), i);
-                    }
-                    else
-                    {
-                        return insertInto(db_path, clusteredIndexNode.get_page_pointers()[i], row, page_size, schema, page_num);
-                    }
-                    added = true;
-                    break;
+                    ClusteredIndexNode holder = ClusteredIndexNode::load(std::move(node));
+                    *replaced = std::exchange(holder.get_items()[position], std::move(dataRow));
+                    holder.save_replaced(db_path, schema, page_size, position);
+                    return *holder.get_original_page();
                 }
-                else if (rows[i].get(*rows[i].primaryKeyIndex()) == dataRow.get(*dataRow.primaryKeyIndex()))
+                if (!schema.bplus_tree || node.pointer(0) == 0)
                 {
                     throw std::runtime_error(
                         "Insert failed: primary key already exists (value = " +
-                        rows[i].get(*rows[i].primaryKeyIndex()).default_value_str() + ")");
+                        key.default_value_str() + ")");
                 }
+                position++;
             }
-            if (!added)
+            bool onEdge = !edge.empty() && position == node.size();
+
+            if (node.pointer(0) == 0)
             {
-                if (clusteredIndexNode.get_page_pointers()[0] == static_cast<uint32_t>(0))
+                ClusteredIndexNode leaf = ClusteredIndexNode::load(std::move(node));
+                leaf.add_row_at(std::move(dataRow), position);
+                leaf.add_pointer_at(static_cast<uint32_t>(0), position);
+                leaf.save_row(db_path, schema, page_size, position);
+                if (onEdge)
+                {
+                    pool->set_right_edge(page_num, std::move(edge));
+                }
+                return *leaf.get_original_page();
+            }
+
+            ClusteredIndexNodeView child = ClusteredIndexNodeView::load(db_path, node.pointer(position), schema, page_size);
+            if (child.size() >= max_rows)
+            {
+                if (onEdge)
+                {
+                    pool->set_right_edge(page_num, {});
+                }
+                ClusteredIndexNode parent = ClusteredIndexNode::load(std::move(node));
+                ClusteredIndexNode fullChild = ClusteredIndexNode::load(std::move(child));
+                split_node(parent, position, fullChild, schema, db_path, page_size);
+
+                const DataType &middle = parent.get_items()[position].get(pk);
+                if (middle == key && !schema.bplus_tree && replaced)
                 {
-                    clusteredIndexNode.add_row(std::move(dataRow));
-                    clusteredIndexNode.add_pointer(static_cast<uint32_t>(0));
+                    *replaced = std::exchange(parent.get_items()[position], std::move(dataRow));
+                    parent.save_replaced(db_path, schema, page_size, position);
+                    return *parent.get_original_page();
+                }
+                if (middle == key && !schema.bplus_tree)
+                {
+                    throw std::runtime_error(
+                        "Insert failed: primary key already exists (value = " +
+                        key.default_value_str() + ")");
+                }
+                if (key < middle)
+                {
+                    onEdge = false;
                 }
                 else
                 {
-                    return insertInto(db_path, clusteredIndexNode.get_page_pointers()[clusteredIndexNode.get_page_pointers().size() - 1], row, page_size, schema, page_num);
+                    position++;
                 }
+                child = ClusteredIndexNodeView::load(db_path, parent.get_page_pointers()[position], schema, page_size);
             }
-        }
-        // clusteredIndexNode.print();
-        // clusteredIndexNode.print();
-        // clusteredIndexNode.to_bits().printHex();
-        clusteredIndexNode.save(db_path, schema, page_size);
 
-        return true;
+            if (onEdge)
+            {
+                edge.push_back(child.page());
+            }
+            else
+            {
+                edge.clear();
+            }
+            node = std::move(child);
+        }
     }
 
     uint32_t split_secondary_root(uint32_t current_page_ref, SecondaryIndexNode &originalNode, const TableSchema &schema, const std::string &db_path, uint32_t page_size)
     {
+        storage::FreeSpaceMap &fsm = storage::BufferPool::shared(db_path, page_size)->free_space(*schema.available_pages_ref);
         std::vector<uint32_t> otherAvailablePages = originalNode.get_available_pages_index();
 
         SecondaryIndexNode newRoot;
@@ -350,7 +601,7 @@ namespace dbone::insert
             page2.add_pointer(originalNode.page_pointers()[i + schema.min_length + 1]);
         }
         page1.add_pointer(originalNode.page_pointers()[schema.min_length]);
-        page2.add_pointer(originalNode.page_pointers()[schema.min_length * 2]);
+        page2.add_pointer(originalNode.page_pointers()[schema.min_length * 2 + 1]);
 
         uint32_t page1Ptr;
         if (otherAvailablePages.size() > 0)
@@ -360,7 +611,7 @@ namespace dbone::insert
         }
         else
         {
-            page1Ptr = num_pages_in_file(db_path, page_size);
+            page1Ptr = fsm.allocate();
         }
         page1.set_original_page(page1Ptr);
         page1.set_available_pages(otherAvailablePages);
@@ -380,11 +631,22 @@ namespace dbone::insert
         }
         else
         {
-            page2Ptr = num_pages_in_file(db_path, page_size);
+            page2Ptr = fsm.allocate();
         }
         page2.set_original_page(page2Ptr);
         page2.set_available_pages(otherAvailablePages);
         std::vector<uint32_t> pagesUsed2 = page2.save(db_path, schema, page_size);
+        for (uint32_t page : pagesUsed2)
+        {
+            otherAvailablePages.erase(
+                std::remove(otherAvailablePages.begin(), otherAvailablePages.end(), page),
+                otherAvailablePages.end());
+        }
+        // Overflow pages of the old node that neither half needed.
+        for (uint32_t page : otherAvailablePages)
+        {
+            fsm.free_page(page);
+        }
 
         newRoot.clear_pointers();
         newRoot.add_pointer(page1Ptr);
@@ -395,33 +657,10 @@ namespace dbone::insert
         return current_page_ref;
     }
 
-    bool forceInsertIntoIndex(const std::string &db_path, uint32_t page_num, IndexEntry &indexEntry, uint32_t page_size, const TableSchema &schema, const Column &indexed_col, const Column &pk_col, uint32_t page1, uint32_t page2, uint32_t previous_page_ref = 0)
-    {
-        SecondaryIndexNode secondaryIndexNode = SecondaryIndexNode::load(db_path, page_num, schema, indexed_col, pk_col, page_size);
-        std::vector<IndexEntry> entries = secondaryIndexNode.entries();
-
-        bool added = false;
-        for (size_t i = 0; i < entries.size(); i++)
-        {
-            if (*(entries[i].value) > *(indexEntry.value))
-            {
-                secondaryIndexNode.add_entry_at(std::move(indexEntry), i);
-                secondaryIndexNode.add_pointer_at(page1, i);
-                secondaryIndexNode.set_pointer_at(page2, i + 1);
-            }
-        }
-        if (!added)
-        {
-            secondaryIndexNode.add_entry(std::move(indexEntry));
-            secondaryIndexNode.set_pointer_at(page1, entries.size());
-            secondaryIndexNode.add_pointer(page2);
-        }
-        secondaryIndexNode.save(db_path, schema, page_size);
-        return false;
-    }
-
-    bool split_secondary_node(uint32_t above_page_ref, SecondaryIndexNode &originalNode, const TableSchema &schema, const std::string &db_path, const Column &indexed_col, const Column &pk_col, uint32_t page_size)
+    // Same as split_node, for a secondary index node
+    void split_secondary_node(SecondaryIndexNode &parent, size_t position, SecondaryIndexNode &originalNode, const TableSchema &schema, const std::string &db_path, uint32_t page_size)
     {
+        storage::FreeSpaceMap &fsm = storage::BufferPool::shared(db_path, page_size)->free_space(*schema.available_pages_ref);
         std::vector<uint32_t> otherAvailablePages = originalNode.get_available_pages_index();
         otherAvailablePages.insert(otherAvailablePages.begin(), *originalNode.original_page());
 
@@ -437,7 +676,7 @@ namespace dbone::insert
             page2.add_pointer(originalNode.page_pointers()[i + schema.min_length + 1]);
         }
         page1.add_pointer(originalNode.page_pointers()[schema.min_length]);
-        page2.add_pointer(originalNode.page_pointers()[schema.min_length * 2]);
+        page2.add_pointer(originalNode.page_pointers()[schema.min_length * 2 + 1]);
 
         uint32_t page1Ptr;
         if (otherAvailablePages.size() > 0)
@@ -447,7 +686,7 @@ namespace dbone::insert
         }
         else
         {
-            page1Ptr = num_pages_in_file(db_path, page_size);
+            page1Ptr = fsm.allocate();
         }
         page1.set_original_page(page1Ptr);
         page1.set_available_pages(otherAvailablePages);
@@ -467,112 +706,124 @@ namespace dbone::insert
         }
         else
         {
-            page2Ptr = num_pages_in_file(db_path, page_size);
+            page2Ptr = fsm.allocate();
         }
         page2.set_original_page(page2Ptr);
         page2.set_available_pages(otherAvailablePages);
         std::vector<uint32_t> pagesUsed2 = page2.save(db_path, schema, page_size);
+        for (uint32_t page : pagesUsed2)
+        {
+            otherAvailablePages.erase(
+                std::remove(otherAvailablePages.begin(), otherAvailablePages.end(), page),
+                otherAvailablePages.end());
+        }
+        // Overflow pages of the old node that neither half needed.
+        for (uint32_t page : otherAvailablePages)
+        {
+            fsm.free_page(page);
+        }
 
 
-        forceInsertIntoIndex(db_path, above_page_ref, rowPush, page_size, schema, indexed_col, pk_col, page1Ptr, page2Ptr);
-
-        return true;
+        parent.add_entry_at(std::move(rowPush), position);
+        parent.add_pointer_at(page1Ptr, position);
+        parent.set_pointer_at(page2Ptr, position + 1);
+        parent.save(db_path, schema, page_size);
     }
 
-    bool insertIntoIndex(const std::string &db_path, uint32_t page_num, const Row &row, uint32_t page_size, const TableSchema &schema, const Column &indexed_col, const Column &pk_col, uint32_t previous_page_ref = 0)
+    // Add a primary key to the postings of an existing value, in order,
+    // with the page of its row when the index keeps locators and the row's
+    // included values when it has some
+    static void add_posting(IndexEntry &entry, std::unique_ptr<DataType> pkValue, uint32_t locator, std::vector<std::unique_ptr<DataType>> included, const TableSchema &schema)
     {
-        SecondaryIndexNode secondaryIndexNode = SecondaryIndexNode::load(db_path, page_num, schema, indexed_col, pk_col, page_size);
-
-
-        std::vector<IndexEntry> entries = secondaryIndexNode.entries();
+        std::vector<std::unique_ptr<DataType>> &keys = entry.primary_keys;
+        size_t at = upper_bound_key(keys.size(), *pkValue, [&](size_t i) -> const DataType & { return *keys[i]; });
+        keys.insert(keys.begin() + at, std::move(pkValue));
+        if (schema.index_locators)
+        {
+            entry.locators.resize(keys.size() - 1);
+            entry.locators.insert(entry.locators.begin() + at, locator);
+        }
+        if (!included.empty())
+        {
+            entry.included.resize(keys.size() - 1);
+            entry.included.insert(entry.included.begin() + at, std::move(included));
+        }
+    }
 
-        if (secondaryIndexNode.entries().size() >= schema.min_length * 2 + 1)
+    // row's values of the columns the index on indexed carries
+    static std::vector<std::unique_ptr<DataType>> parse_included(const TableSchema &schema, size_t indexed, const Row &row)
+    {
+        std::vector<std::unique_ptr<DataType>> values;
+        for (size_t col : included_columns(schema, indexed))
         {
-            if (previous_page_ref == 0)
-            {
-                split_secondary_root(page_num, secondaryIndexNode, schema, db_path, page_size);
-                return insertIntoIndex(db_path, page_num, row, page_size, schema, indexed_col, pk_col, previous_page_ref);
-            }
-            else
-            {
-                split_secondary_node(previous_page_ref, secondaryIndexNode, schema, db_path, indexed_col, pk_col, page_size);
-                return insertIntoIndex(db_path, page_num, row, page_size, schema, indexed_col, pk_col, previous_page_ref);
-            }
+            const Column &column = *schema.columns[col];
+            values.push_back(column.parse(row.at(column.name())));
         }
+        return values;
+    }
 
-        if (secondaryIndexNode.entries().size() == 0)
+    bool insertIntoIndex(const std::string &db_path, uint32_t page_num, std::unique_ptr<DataType> indexedValue, const DataType &primaryKey, uint32_t locator, std::vector<std::unique_ptr<DataType>> included, uint32_t page_size, const TableSchema &schema, const Column &indexed_col, const Column &pk_col)
+    {
+        const size_t max_entries = schema.min_length * 2 + 1;
+
+        // One pass from the root, splitting full nodes on the way down as
+        // insertInto does.
+        SecondaryIndexNode secondaryIndexNode = SecondaryIndexNode::load(db_path, page_num, schema, indexed_col, pk_col, page_size);
+        if (secondaryIndexNode.entries().size() >= max_entries)
         {
-            IndexEntry indexEntry;
-            indexEntry.value = indexed_col.parse(row.at(indexed_col.name()));
-            indexEntry.primary_keys.push_back(pk_col.parse(row.at(pk_col.name())));
-            secondaryIndexNode.add_entry(std::move(indexEntry));
-            secondaryIndexNode.add_pointer(0);
+            split_secondary_root(page_num, secondaryIndexNode, schema, db_path, page_size);
+            secondaryIndexNode = SecondaryIndexNode::load(db_path, page_num, schema, indexed_col, pk_col, page_size);
         }
-        else
+
+        while (true)
         {
-            std::unique_ptr<DataType> indexedValue = indexed_col.parse(row.at(indexed_col.name()));
-            bool adding = false;
-            for (size_t i = 0; i < entries.size(); i++)
+            std::vector<IndexEntry> &entries = secondaryIndexNode.entries();
+            size_t position = lower_bound_key(entries.size(), *indexedValue, [&](size_t i) -> const DataType & { return *entries[i].value; });
+
+            if (position < entries.size() && *entries[position].value == *indexedValue)
             {
+                // Value already indexed: add the key to its postings
+                add_posting(entries[position], primaryKey.clone(), locator, std::move(included), schema);
+                secondaryIndexNode.save(db_path, schema, page_size);
+                return false;
+            }
 
-                if (*(entries[i].value) > *(indexedValue))
+            if (entries.empty() || secondaryIndexNode.page_pointers()[0] == static_cast<uint32_t>(0))
+            {
+                IndexEntry indexEntry;
+                indexEntry.value = std::move(indexedValue);
+                indexEntry.primary_keys.push_back(primaryKey.clone());
+                if (schema.index_locators)
                 {
-                    if (secondaryIndexNode.page_pointers()[0] == static_cast<uint32_t>(0))
-                    {
-                        IndexEntry indexEntry;
-                        indexEntry.value = indexed_col.parse(row.at(indexed_col.name()));
-                        indexEntry.primary_keys.push_back(pk_col.parse(row.at(pk_col.name())));
-                        secondaryIndexNode.add_entry_at(std::move(indexEntry), i);
-                        adding = true;
-                        break;
-                    }
-                    else
-                    {
-                        adding = true;
-                        return insertIntoIndex(db_path, secondaryIndexNode.page_pointers()[i], row, page_size, schema, indexed_col, pk_col, page_num);
-                    }
+                    indexEntry.locators.push_back(locator);
                 }
-                else if (entries[i].value == indexedValue)
+                if (!included.empty())
                 {
-                    IndexEntry indexEntry = entries[i];
-                    std::unique_ptr<DataType> pkValue = pk_col.parse(row.at(pk_col.name()));
-                    bool added = false;
-                    for (size_t i = 0; i < indexEntry.primary_keys.size(); i++)
-                    {
-                        if (indexEntry.primary_keys[i] < pkValue)
-                        {
-                            indexEntry.primary_keys.insert(indexEntry.primary_keys.begin() + i, std::move(pkValue));
-                            added = true;
-                        }
-                    }
-                    if (!added)
-                    {
-                        indexEntry.primary_keys.push_back(std::move(pkValue));
-                    }
-                    adding = true;
-                    break;
+                    indexEntry.included.push_back(std::move(included));
                 }
+                secondaryIndexNode.add_entry_at(std::move(indexEntry), position);
+                secondaryIndexNode.add_pointer_at(0, position);
+                secondaryIndexNode.save(db_path, schema, page_size);
+                return false;
             }
-            if (!adding)
+
+            SecondaryIndexNode child = SecondaryIndexNode::load(db_path, secondaryIndexNode.page_pointers()[position], schema, indexed_col, pk_col, page_size);
+            if (child.entries().size() >= max_entries)
             {
-                if (secondaryIndexNode.page_pointers()[entries.size()] == 0)
-                {
-                    IndexEntry indexEntry;
-                    indexEntry.value = indexed_col.parse(row.at(indexed_col.name()));
-                    indexEntry.primary_keys.push_back(pk_col.parse(row.at(pk_col.name())));
-                    secondaryIndexNode.add_entry(std::move(indexEntry));
-                    secondaryIndexNode.add_pointer(0);
-                }
-                else
+                split_secondary_node(secondaryIndexNode, position, child, schema, db_path, page_size);
+
+                IndexEntry &middle = secondaryIndexNode.entries()[position];
+                if (*middle.value == *indexedValue)
                 {
-                    return insertIntoIndex(db_path, secondaryIndexNode.page_pointers()[entries.size()], row, page_size, schema, indexed_col, pk_col, page_num);
+                    add_posting(middle, primaryKey.clone(), locator, std::move(included), schema);
+                    secondaryIndexNode.save(db_path, schema, page_size);
+                    return false;
                 }
+                uint32_t half = secondaryIndexNode.page_pointers()[*indexedValue < *middle.value ? position : position + 1];
+                child = SecondaryIndexNode::load(db_path, half, schema, indexed_col, pk_col, page_size);
             }
+            secondaryIndexNode = std::move(child);
         }
-
-        secondaryIndexNode.save(db_path, schema, page_size);
-
-        return false;
     }
 
     ValidationResult insert(const std::string &db_path, const Row &row, uint32_t page_size)
@@ -584,31 +835,189 @@ namespace dbone::insert
             return {false, "Failed to load schema: " + err};
         }
 
+        return insert(db_path, schema, row, page_size);
+    }
+
+    ValidationResult insert(const std::string &db_path, const TableSchema &schema, const Row &row, uint32_t page_size)
+    {
         ValidationResult validationResult = validate_row(schema, row);
+        if (!validationResult.ok)
+        {
+            return validationResult;
+        }
+        std::optional<size_t> pk = primary_key_index(schema);
+        if (!pk)
+        {
+            return {false, "insert: table has no primary key"};
+        }
+        const Column &pk_col = *schema.columns[*pk];
 
+        // One transaction covers the row, every split it triggers and the
+        // index entries, so with a WAL the insert is all-or-nothing.
+        storage::BufferPool::Transaction txn = storage::BufferPool::shared(db_path, page_size)->begin();
 
-        insertInto(db_path, *schema.clustered_page_ref, row, page_size, schema);
+        uint32_t landed = insertInto(db_path, *schema.clustered_page_ref, row, page_size, schema);
 
+        std::unique_ptr<DataType> pkValue = pk_col.parse(row.at(pk_col.name()));
+        for (const auto &[colIndex, pageRef] : schema.index_page_refs)
+        {
+            const Column &indexed_col = *schema.columns[colIndex];
+            insertIntoIndex(db_path, pageRef, indexed_col.parse(row.at(indexed_col.name())), *pkValue, landed, parse_included(schema, colIndex, row), page_size, schema, indexed_col, pk_col);
+        }
 
-        Column *pk_col = nullptr;
-        for (size_t i = 0; i < schema.columns.size(); i++)
+        txn.commit();
+        return validationResult;
+    }
+
+    UpdateResult update(const std::string &db_path, const DataType &primaryKey, const Row &changes, uint32_t page_size)
+    {
+        TableSchema schema = read_schema(db_path, page_size);
+        return update(db_path, schema, primaryKey, changes, page_size);
+    }
+
+    UpdateResult update(const std::string &db_path, const TableSchema &schema, const DataType &primaryKey, const Row &changes, uint32_t page_size)
+    {
+        std::optional<size_t> pk = primary_key_index(schema);
+        if (!pk)
         {
-            if (schema.columns[i]->primaryKey())
+            return {false, "update: table has no primary key"};
+        }
+        const Column &pk_col = *schema.columns[*pk];
+        if (primaryKey.type_name() != pk_col.default_val()->type_name())
+        {
+            return {false, "update: key is not a " + pk_col.default_val()->type_name() + " like column " + pk_col.name()};
+        }
+
+        // Every new value is parsed before anything is written
+        std::vector<std::pair<size_t, std::unique_ptr<DataType>>> values;
+        for (const auto &[name, raw] : changes)
+        {
+            auto it = std::find_if(schema.columns.begin(), schema.columns.end(), [&name](const std::unique_ptr<Column> &col)
+                                   { return col->name() == name; });
+            if (it == schema.columns.end())
             {
-                pk_col = schema.columns[i].get(); // raw pointer to the column
-                break;
+                return {false, "Column '" + name + "' does not exist in table schema"};
+            }
+            const Column &col = **it;
+            if (col.primaryKey())
+            {
+                return {false, "update: primary key column '" + name + "' can't be changed"};
+            }
+            if (raw.empty() && !col.nullable())
+            {
+                return {false, "Column '" + name + "' is NOT NULL but missing in update"};
             }
+            values.emplace_back(static_cast<size_t>(it - schema.columns.begin()), col.parse(raw));
         }
 
+        std::shared_ptr<storage::BufferPool> pool = storage::BufferPool::shared(db_path, page_size);
+        storage::BufferPool::Transaction txn = pool->begin();
 
-        for (const auto &[colIndex, pageRef] : schema.index_page_refs)
+        // Down to the node that holds the key through views; only that node
+        // is decoded, and only its changed row is written back
+        uint32_t page = *schema.clustered_page_ref;
+        while (true)
+        {
+            ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, page, schema, page_size);
+            size_t position = node.lower_bound(primaryKey);
+            bool leaf = node.pointer(0) == 0;
+            if (position < node.size() && node.compare_key(position, primaryKey) == 0)
+            {
+                if (!schema.bplus_tree || leaf)
+                {
+                    ClusteredIndexNode holder = ClusteredIndexNode::load(std::move(node));
+                    DataRow &row = holder.get_items()[position];
+                    std::unordered_map<size_t, std::unique_ptr<DataType>> was; // values replaced
+                    for (auto &[col, value] : values)
+                    {
+                        if (!(row.get(col) == *value))
+                        {
+                            was[col] = row.get(col).clone();
+                        }
+                        row.set(col, std::move(value));
+                    }
+                    holder.save_replaced(db_path, schema, page_size, position);
+
+                    // An index is touched when its value or one it includes changed
+                    for (const auto &[col, pageRef] : schema.index_page_refs)
+                    {
+                        std::vector<size_t> carried = included_columns(schema, col);
+                        if (!was.count(col) && std::none_of(carried.begin(), carried.end(), [&was](size_t c)
+                                                            { return was.count(c) > 0; }))
+                        {
+                            continue;
+                        }
+                        remove::remove_posting(db_path, schema, col, was.count(col) ? *was.at(col) : row.get(col), primaryKey, page_size);
+                        insertIntoIndex(db_path, pageRef, row.get(col).clone(), primaryKey, *holder.get_original_page(), included_values(schema, col, row), page_size, schema, *schema.columns[col], pk_col);
+                    }
+                    txn.commit();
+                    return {true, "", true};
+                }
+                // A B+tree separator equal to the key sends it right
+                position++;
+            }
+            if (leaf)
+            {
+                return {true, "", false};
+            }
+            page = node.pointer(position);
+        }
+    }
+
+    UpdateResult upsert(const std::string &db_path, const Row &row, uint32_t page_size)
+    {
+        TableSchema schema = read_schema(db_path, page_size);
+        return upsert(db_path, schema, row, page_size);
+    }
+
+    UpdateResult upsert(const std::string &db_path, const TableSchema &schema, const Row &row, uint32_t page_size)
+    {
+        ValidationResult validationResult = validate_row(schema, row);
+        if (!validationResult.ok)
+        {
+            return {false, validationResult.error};
+        }
+        std::optional<size_t> pk = primary_key_index(schema);
+        if (!pk)
         {
-            insertIntoIndex(db_path, pageRef, row, page_size, schema, *schema.columns[colIndex], *pk_col);
+            return {false, "upsert: table has no primary key"};
         }
+        const Column &pk_col = *schema.columns[*pk];
 
-        schema.index_page_refs;
+        storage::BufferPool::Transaction txn = storage::BufferPool::shared(db_path, page_size)->begin();
 
-        return validationResult;
+        std::optional<DataRow> old;
+        uint32_t landed = insertInto(db_path, *schema.clustered_page_ref, row, page_size, schema, &old);
+        bool inserted = !old;
+
+        // A replaced row keeps its index entries where the value, and any
+        // value included with it, is the same
+        std::unique_ptr<DataType> pkValue = pk_col.parse(row.at(pk_col.name()));
+        for (const auto &[colIndex, pageRef] : schema.index_page_refs)
+        {
+            const Column &indexed_col = *schema.columns[colIndex];
+            std::unique_ptr<DataType> value = indexed_col.parse(row.at(indexed_col.name()));
+            std::vector<std::unique_ptr<DataType>> included = parse_included(schema, colIndex, row);
+            if (!inserted)
+            {
+                const DataType &was = old->get(colIndex);
+                std::vector<std::unique_ptr<DataType>> wasIncluded = included_values(schema, colIndex, *old);
+                bool same = was == *value;
+                for (size_t i = 0; same && i < included.size(); i++)
+                {
+                    same = *wasIncluded[i] == *included[i];
+                }
+                if (same)
+                {
+                    continue;
+                }
+                remove::remove_posting(db_path, schema, colIndex, was, *pkValue, page_size);
+            }
+            insertIntoIndex(db_path, pageRef, std::move(value), *pkValue, landed, std::move(included), page_size, schema, indexed_col, pk_col);
+        }
+
+        txn.commit();
+        return {true, "", !inserted};
     }
 
 } // namespace dbone::insert
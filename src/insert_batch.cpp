@@ -0,0 +1,410 @@
+#include "dbone/insert.hpp"
+#include "dbone/schema.hpp"
+#include "dbone/clustered_index_node.hpp"
+#include "dbone/secondary_index_node.hpp"
+#include "dbone/buffer_pool.hpp"
+#include "tree_access.hpp"
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+namespace dbone::insert
+{
+
+    namespace
+    {
+        using detail::ClusteredTree;
+        using detail::Placement;
+        using detail::SecondaryTree;
+
+        // Merges a batch of items, sorted by key, into one tree. Each node
+        // whose subtree receives part of the batch is read once and written
+        // at most once, after its children: a leaf takes its share in one
+        // merge, and a node that overflows is cut into as many even pieces
+        // as it needs, the first keeping its page and the separators going
+        // up to the parent in the same pass. B+tree leaves keep every row
+        // and send up a key-only copy of each new piece's first one.
+        template <typename Tree>
+        class BatchWriter
+        {
+        public:
+            using Node = typename Tree::Node;
+            using Item = typename Tree::Item;
+            using Iter = typename std::vector<Item>::iterator;
+
+            BatchWriter(const Tree &tree, storage::FreeSpaceMap &fsm, size_t max_items)
+                : tree_(tree), fsm_(fsm), max_items_(max_items) {}
+
+            void apply(uint32_t root_page, std::vector<Item> &batch)
+            {
+                if (batch.empty())
+                {
+                    return;
+                }
+                Node root = tree_.load(root_page);
+                std::vector<Item> items;
+                std::vector<uint32_t> pointers;
+                merge(root, batch.begin(), batch.end(), items, pointers);
+
+                // The root keeps its page: while its contents overflow they
+                // move down into new nodes and the root holds the separators.
+                while (items.size() > max_items_)
+                {
+                    std::vector<Item> separators;
+                    pointers = write_pieces(nullptr, items, pointers, separators);
+                    items = std::move(separators);
+                }
+                write(root, items, pointers);
+            }
+
+        private:
+            struct Split
+            {
+                Item separator;
+                uint32_t right; // page of the piece after the separator
+            };
+
+            std::vector<Split> apply_at(uint32_t page, Iter first, Iter last)
+            {
+                Node node = tree_.load(page);
+                std::vector<Item> items;
+                std::vector<uint32_t> pointers;
+                if (!merge(node, first, last, items, pointers))
+                {
+                    return {};
+                }
+                if (items.size() <= max_items_)
+                {
+                    write(node, items, pointers);
+                    return {};
+                }
+
+                std::vector<Item> separators;
+                std::vector<uint32_t> pages = write_pieces(&node, items, pointers, separators);
+                std::vector<Split> splits;
+                splits.reserve(separators.size());
+                for (size_t i = 0; i < separators.size(); i++)
+                {
+                    splits.push_back({std::move(separators[i]), pages[i + 1]});
+                }
+                return splits;
+            }
+
+            // The node's contents with [first, last) merged in, into items
+            // and pointers. Returns false when nothing changed.
+            bool merge(Node &node, Iter first, Iter last, std::vector<Item> &items, std::vector<uint32_t> &pointers)
+            {
+                std::vector<Item> &old_items = Tree::items(node);
+                std::vector<uint32_t> &old_pointers = Tree::pointers(node);
+                items.reserve(old_items.size() + static_cast<size_t>(last - first));
+
+                if (old_pointers.empty() || old_pointers[0] == 0)
+                {
+                    size_t i = 0;
+                    while (i < old_items.size() || first != last)
+                    {
+                        if (first == last || (i < old_items.size() && tree_.key(old_items[i]) < tree_.key(*first)))
+                        {
+                            items.push_back(std::move(old_items[i++]));
+                        }
+                        else if (i == old_items.size() || tree_.key(*first) < tree_.key(old_items[i]))
+                        {
+                            items.push_back(std::move(*first++));
+                        }
+                        else
+                        {
+                            tree_.merge(old_items[i], std::move(*first++));
+                        }
+                    }
+                    pointers.assign(items.size() + 1, 0);
+                    return true;
+                }
+
+                bool changed = false;
+                for (size_t c = 0; c <= old_items.size(); c++)
+                {
+                    Iter end = last;
+                    if (c < old_items.size())
+                    {
+                        const DataType &bound = tree_.key(old_items[c]);
+                        end = std::partition_point(first, last, [&](const Item &item)
+                                                   { return tree_.key(item) < bound; });
+                    }
+
+                    pointers.push_back(old_pointers[c]);
+                    if (first != end)
+                    {
+                        for (Split &split : apply_at(old_pointers[c], first, end))
+                        {
+                            items.push_back(std::move(split.separator));
+                            pointers.push_back(split.right);
+                            changed = true;
+                        }
+                    }
+                    first = end;
+
+                    if (c < old_items.size())
+                    {
+                        // A B+tree separator equal to a key sends it right
+                        while (!tree_.leaf_rows() && first != last && !(tree_.key(old_items[c]) < tree_.key(*first)))
+                        {
+                            tree_.merge(old_items[c], std::move(*first++));
+                            changed = true;
+                        }
+                        items.push_back(std::move(old_items[c]));
+                    }
+                }
+                return changed;
+            }
+
+            // Rewrite node in place with the given contents
+            void write(Node &node, std::vector<Item> &items, std::vector<uint32_t> &pointers)
+            {
+                Tree::items(node) = std::move(items);
+                Tree::pointers(node) = std::move(pointers);
+                detail::write_node(tree_, fsm_, node);
+            }
+
+            // Cut items into the fewest pieces of at most max_items_ each,
+            // sized evenly, with one separator between neighbours. The first
+            // piece goes to node when given, the others to new pages; linked
+            // leaves are linked in order between node's old neighbours.
+            // Returns the page of every piece.
+            std::vector<uint32_t> write_pieces(Node *node, std::vector<Item> &items, std::vector<uint32_t> &pointers, std::vector<Item> &separators)
+            {
+                const size_t n = items.size();
+                const bool linked = tree_.leaf_rows() && pointers[0] == 0;
+                const size_t pieces = linked ? (n + max_items_ - 1) / max_items_ : (n + 1 + max_items_) / (max_items_ + 1);
+                const size_t kept = linked ? n : n - (pieces - 1);
+
+                std::vector<uint32_t> pages;
+                for (size_t p = 0; p < pieces; p++)
+                {
+                    pages.push_back(p == 0 && node != nullptr ? Tree::page(*node) : fsm_.allocate());
+                }
+                uint32_t prev = node != nullptr ? Tree::prev_leaf(*node) : 0;
+                uint32_t next_leaf = node != nullptr ? Tree::next_leaf(*node) : 0;
+
+                size_t next = 0;
+                for (size_t p = 0; p < pieces; p++)
+                {
+                    if (p > 0 && !linked)
+                    {
+                        separators.push_back(std::move(items[next++]));
+                    }
+
+                    size_t count = kept / pieces + (p < kept % pieces ? 1 : 0);
+                    std::vector<Item> piece_items;
+                    std::vector<uint32_t> piece_pointers;
+                    piece_items.reserve(count);
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        piece_pointers.push_back(pointers[next]);
+                        piece_items.push_back(std::move(items[next++]));
+                    }
+                    piece_pointers.push_back(pointers[next]);
+                    if (linked && p + 1 < pieces)
+                    {
+                        separators.push_back(tree_.separator(piece_items.back(), items[next]));
+                    }
+
+                    Node fresh;
+                    Node &target = p == 0 && node != nullptr ? *node : fresh;
+                    if (&target == &fresh)
+                    {
+                        fresh.set_original_page(pages[p]);
+                    }
+                    if (linked)
+                    {
+                        Tree::link(target, p == 0 ? prev : pages[p - 1], p + 1 < pieces ? pages[p + 1] : next_leaf);
+                    }
+                    write(target, piece_items, piece_pointers);
+                }
+                if (linked && next_leaf != 0)
+                {
+                    tree_.set_prev_leaf(next_leaf, pages.back());
+                }
+                return pages;
+            }
+
+            const Tree &tree_;
+            storage::FreeSpaceMap &fsm_;
+            size_t max_items_;
+        };
+
+        // First key of the sorted batch [first, last) already stored in the
+        // subtree at page, if any. Read-only, so a duplicate is caught before
+        // the batch writes anything.
+        const DataType *find_existing(const ClusteredTree &tree, uint32_t page,
+                                      std::vector<DataRow>::const_iterator first, std::vector<DataRow>::const_iterator last)
+        {
+            ClusteredIndexNodeView node = ClusteredIndexNodeView::load(tree.db_path, page, tree.schema, tree.page_size);
+            while (first != last)
+            {
+                size_t position = node.lower_bound(tree.key(*first));
+                if (position < node.size() && node.compare_key(position, tree.key(*first)) == 0)
+                {
+                    // A B+tree separator is not a row; the key goes right
+                    if (!tree.leaf_rows() || node.pointer(0) == 0)
+                    {
+                        return &tree.key(*first);
+                    }
+                    position++;
+                }
+
+                // Every batch key below the node key at position goes to
+                // the same child
+                auto end = last;
+                if (position < node.size())
+                {
+                    end = std::partition_point(first, last, [&](const DataRow &row)
+                                               { return node.compare_key(position, tree.key(row)) > 0; });
+                }
+                if (node.pointer(0) != 0)
+                {
+                    if (const DataType *existing = find_existing(tree, node.pointer(position), first, end))
+                    {
+                        return existing;
+                    }
+                }
+                first = end;
+            }
+            return nullptr;
+        }
+
+        struct Posting
+        {
+            std::unique_ptr<DataType> value;
+            std::unique_ptr<DataType> primary_key;
+            std::vector<std::unique_ptr<DataType>> included;
+        };
+    } // namespace
+
+    ValidationResult insert_batch(const std::string &db_path, std::span<const Row> rows, uint32_t page_size)
+    {
+        TableSchema schema = read_schema(db_path, page_size);
+        return insert_batch(db_path, schema, rows, page_size);
+    }
+
+    ValidationResult insert_batch(const std::string &db_path, const TableSchema &schema, std::span<const Row> rows, uint32_t page_size)
+    {
+        std::optional<size_t> pk_index = primary_key_index(schema);
+        if (!pk_index)
+        {
+            return {false, "insert_batch: table has no primary key"};
+        }
+        const Column &pk_col = *schema.columns[*pk_index];
+
+        std::vector<DataRow> batch;
+        batch.reserve(rows.size());
+        for (const Row &row : rows)
+        {
+            ValidationResult validationResult = validate_row(schema, row);
+            if (!validationResult.ok)
+            {
+                return validationResult;
+            }
+            batch.push_back(DataRow::fromRow(row, schema));
+        }
+        if (batch.empty())
+        {
+            return {true, ""};
+        }
+
+        const size_t pk = *pk_index;
+        std::sort(batch.begin(), batch.end(), [pk](const DataRow &a, const DataRow &b)
+                  { return a.get(pk) < b.get(pk); });
+        for (size_t i = 1; i < batch.size(); i++)
+        {
+            if (batch[i - 1].get(pk) == batch[i].get(pk))
+            {
+                return {false, "insert_batch: primary key repeated in batch (value = " + batch[i].get(pk).default_value_str() + ")"};
+            }
+        }
+
+        // Postings for each secondary index, taken before the rows move
+        // into the clustered tree. Stable, so the keys of equal values stay
+        // in ascending order.
+        std::vector<std::pair<size_t, std::vector<IndexEntry>>> indexes;
+        for (const auto &[colIndex, pageRef] : schema.index_page_refs)
+        {
+            std::vector<Posting> postings;
+            postings.reserve(batch.size());
+            for (const DataRow &row : batch)
+            {
+                postings.push_back({row.get(colIndex).clone(), row.get(pk).clone(), included_values(schema, colIndex, row)});
+            }
+            std::stable_sort(postings.begin(), postings.end(), [](const Posting &a, const Posting &b)
+                             { return *a.value < *b.value; });
+
+            std::vector<IndexEntry> entries;
+            for (Posting &posting : postings)
+            {
+                if (entries.empty() || !(*entries.back().value == *posting.value))
+                {
+                    entries.emplace_back(std::move(posting.value));
+                }
+                entries.back().primary_keys.push_back(std::move(posting.primary_key));
+                if (!posting.included.empty())
+                {
+                    entries.back().included.push_back(std::move(posting.included));
+                }
+            }
+            indexes.emplace_back(colIndex, std::move(entries));
+        }
+
+        // One transaction for the whole batch, so with a WAL it is
+        // all-or-nothing like a single insert. The duplicate check runs
+        // inside it: no other writer can add one of the keys before the
+        // batch lands.
+        std::shared_ptr<storage::BufferPool> pool = storage::BufferPool::shared(db_path, page_size);
+        storage::BufferPool::Transaction txn = pool->begin();
+        ClusteredTree clustered{db_path, schema, page_size, pk};
+        if (const DataType *existing = find_existing(clustered, *schema.clustered_page_ref, batch.cbegin(), batch.cend()))
+        {
+            return {false, "insert_batch: primary key already exists (value = " + existing->default_value_str() + ")"};
+        }
+        pool->set_right_edge(*schema.clustered_page_ref, {});
+        storage::FreeSpaceMap &fsm = pool->free_space(*schema.available_pages_ref);
+        const size_t max_items = schema.min_length * 2 + 1;
+
+        // With index locators each posting gets the page its row was last
+        // written to, once the clustered pass is done
+        Placement placement;
+        if (schema.index_locators && !indexes.empty())
+        {
+            placement.keys.reserve(batch.size());
+            for (const DataRow &row : batch)
+            {
+                placement.keys.push_back(row.get(pk).clone());
+            }
+            placement.pages.assign(batch.size(), 0);
+        }
+        if (!placement.keys.empty())
+        {
+            clustered.placement = &placement;
+        }
+        BatchWriter<ClusteredTree>(clustered, fsm, max_items).apply(*schema.clustered_page_ref, batch);
+
+        for (auto &[colIndex, entries] : indexes)
+        {
+            if (clustered.placement)
+            {
+                for (IndexEntry &entry : entries)
+                {
+                    for (const std::unique_ptr<DataType> &key : entry.primary_keys)
+                    {
+                        entry.locators.push_back(placement.page_of(*key));
+                    }
+                }
+            }
+            const SecondaryTree index{db_path, schema, page_size, *schema.columns[colIndex], pk_col};
+            BatchWriter<SecondaryTree>(index, fsm, max_items).apply(schema.index_page_refs.at(colIndex), entries);
+        }
+
+        txn.commit();
+        return {true, ""};
+    }
+
+} // namespace dbone::insert
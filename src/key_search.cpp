@@ -0,0 +1,96 @@
+#include "dbone/key_search.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DBONE_HAVE_X86_KERNELS 1
+#endif
+
+namespace dbone
+{
+
+    namespace
+    {
+        // Runs at most this long are counted instead of bisected further
+        constexpr size_t COUNT_RUN = 32;
+
+        using CountLess = size_t (*)(const int64_t *keys, size_t n, int64_t probe);
+
+        size_t count_less_scalar(const int64_t *keys, size_t n, int64_t probe)
+        {
+            size_t count = 0;
+            for (size_t i = 0; i < n; i++)
+                count += keys[i] < probe ? 1 : 0;
+            return count;
+        }
+
+#if defined(DBONE_HAVE_X86_KERNELS)
+        // Each lane of the compare is -1 where probe > key; subtracting it
+        // counts the keys below the probe per lane.
+        __attribute__((target("avx2"))) size_t count_less_avx2(const int64_t *keys, size_t n, int64_t probe)
+        {
+            const __m256i p = _mm256_set1_epi64x(probe);
+            __m256i acc = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+                acc = _mm256_sub_epi64(acc, _mm256_cmpgt_epi64(p, k));
+            }
+            alignas(32) int64_t lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+            size_t count = static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+            return count + count_less_scalar(keys + i, n - i, probe);
+        }
+
+        __attribute__((target("sse4.2"))) size_t count_less_sse42(const int64_t *keys, size_t n, int64_t probe)
+        {
+            const __m128i p = _mm_set1_epi64x(probe);
+            __m128i acc = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2)
+            {
+                __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+                acc = _mm_sub_epi64(acc, _mm_cmpgt_epi64(p, k));
+            }
+            alignas(16) int64_t lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i *>(lanes), acc);
+            size_t count = static_cast<size_t>(lanes[0] + lanes[1]);
+            return count + count_less_scalar(keys + i, n - i, probe);
+        }
+#endif
+
+        CountLess pick_count_less()
+        {
+#if defined(DBONE_HAVE_X86_KERNELS)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return count_less_avx2;
+            if (__builtin_cpu_supports("sse4.2"))
+                return count_less_sse42;
+#endif
+            return count_less_scalar;
+        }
+    } // namespace
+
+    size_t lower_bound_i64(const int64_t *keys, size_t n, int64_t probe)
+    {
+        static const CountLess count_less = pick_count_less();
+
+        size_t lo = 0;
+        while (n > COUNT_RUN)
+        {
+            size_t half = n / 2;
+            if (keys[lo + half] < probe)
+            {
+                lo += half + 1;
+                n -= half + 1;
+            }
+            else
+            {
+                n = half;
+            }
+        }
+        return lo + count_less(keys + lo, n, probe);
+    }
+
+} // namespace dbone
@@ -0,0 +1,410 @@
+#include "dbone/remove.hpp"
+#include "dbone/schema.hpp"
+#include "dbone/clustered_index_node.hpp"
+#include "dbone/secondary_index_node.hpp"
+#include "dbone/buffer_pool.hpp"
+#include "dbone/key_search.hpp"
+#include "tree_access.hpp"
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace dbone::remove
+{
+
+    namespace
+    {
+        using detail::ClusteredTree;
+        using detail::SecondaryTree;
+
+        // Removes items from one tree. A node other than the root that falls
+        // below min_items borrows an item from a sibling that has one to
+        // spare, or else is merged with it and the separator between them;
+        // pages a node no longer needs go back to the free-space map. An item
+        // removed from an inner node of a B-tree is replaced by its
+        // predecessor. B+tree rows are only in leaves, and the separators
+        // above stay as they are: they still divide the keys. The root keeps
+        // its page; once it has no items left above a single child, the child
+        // moves up into it.
+        template <typename Tree>
+        class Remover
+        {
+        public:
+            using Node = typename Tree::Node;
+            using Item = typename Tree::Item;
+
+            Remover(const Tree &tree, storage::FreeSpaceMap &fsm, size_t min_items)
+                : tree_(tree), fsm_(fsm), min_items_(min_items) {}
+
+            // Find the item with key under root_page and pass it to take,
+            // which returns whether the item leaves the tree (the postings of
+            // an index entry may still hold other keys). Returns false if no
+            // item has that key.
+            template <typename Take>
+            bool remove(uint32_t root_page, const DataType &key, Take take)
+            {
+                return remove_from(root_page, key, take, true).found;
+            }
+
+        private:
+            struct Outcome
+            {
+                bool found;
+                bool underfull; // the node was left with fewer than min_items
+            };
+
+            template <typename Take>
+            Outcome remove_from(uint32_t page, const DataType &key, Take &take, bool root)
+            {
+                Node node = tree_.load(page);
+                std::vector<Item> &items = Tree::items(node);
+                std::vector<uint32_t> &pointers = Tree::pointers(node);
+                const bool leaf = pointers[0] == 0;
+
+                size_t position = lower_bound_key(items.size(), key, [&](size_t i) -> const DataType &
+                                                  { return tree_.key(items[i]); });
+                bool here = position < items.size() && tree_.key(items[position]) == key;
+                if (here && tree_.leaf_rows() && !leaf)
+                {
+                    // A B+tree separator is not a row; the key is to its right
+                    position++;
+                    here = false;
+                }
+
+                if (!here)
+                {
+                    if (leaf)
+                    {
+                        return {false, false};
+                    }
+                    Outcome below = remove_from(pointers[position], key, take, false);
+                    if (!below.found || !below.underfull)
+                    {
+                        return {below.found, false};
+                    }
+                    rebalance(node, position);
+                }
+                else if (!take(items[position]))
+                {
+                    write(node);
+                    return {true, false};
+                }
+                else if (leaf)
+                {
+                    items.erase(items.begin() + static_cast<std::ptrdiff_t>(position));
+                    pointers.erase(pointers.begin() + static_cast<std::ptrdiff_t>(position) + 1);
+                }
+                else
+                {
+                    replace_with_predecessor(node, position);
+                }
+
+                if (root)
+                {
+                    collapse_root(node);
+                    return {true, false};
+                }
+                write(node);
+                return {true, items.size() < min_items_};
+            }
+
+            void replace_with_predecessor(Node &node, size_t position)
+            {
+                std::vector<Item> &items = Tree::items(node);
+                std::vector<uint32_t> &pointers = Tree::pointers(node);
+                bool underfull = false;
+                std::optional<Item> predecessor = take_last(pointers[position], underfull);
+                if (predecessor)
+                {
+                    items[position] = std::move(*predecessor);
+                    if (underfull)
+                    {
+                        rebalance(node, position);
+                    }
+                    return;
+                }
+                // Nothing to its left: the item goes, with its empty left subtree
+                free_subtree(pointers[position]);
+                items.erase(items.begin() + static_cast<std::ptrdiff_t>(position));
+                pointers.erase(pointers.begin() + static_cast<std::ptrdiff_t>(position));
+            }
+
+            // Remove and return the largest item under page, if it holds any.
+            // A subtree can be empty below a right edge that insert started
+            // and never filled.
+            std::optional<Item> take_last(uint32_t page, bool &underfull)
+            {
+                Node node = tree_.load(page);
+                std::vector<Item> &items = Tree::items(node);
+                std::vector<uint32_t> &pointers = Tree::pointers(node);
+
+                std::optional<Item> last;
+                if (pointers[0] != 0)
+                {
+                    bool child_underfull = false;
+                    last = take_last(pointers.back(), child_underfull);
+                    if (last && !child_underfull)
+                    {
+                        return last;
+                    }
+                    if (last)
+                    {
+                        rebalance(node, pointers.size() - 1);
+                    }
+                    else if (!items.empty())
+                    {
+                        free_subtree(pointers.back());
+                        pointers.pop_back();
+                    }
+                }
+                if (!last)
+                {
+                    if (items.empty())
+                    {
+                        return std::nullopt;
+                    }
+                    last = std::move(items.back());
+                    items.pop_back();
+                    if (pointers[0] == 0)
+                    {
+                        pointers.pop_back();
+                    }
+                }
+                write(node);
+                underfull = items.size() < min_items_;
+                return last;
+            }
+
+            // The child at position of node has too few items: move one over
+            // from a neighbour through the separator between them, or merge
+            // the two. node itself is left for the caller to write.
+            void rebalance(Node &node, size_t position)
+            {
+                std::vector<Item> &items = Tree::items(node);
+                std::vector<uint32_t> &pointers = Tree::pointers(node);
+                if (items.empty())
+                {
+                    return; // an only child has no neighbour
+                }
+
+                // Prefer the left neighbour; the first child has only a right one
+                size_t separator = position > 0 ? position - 1 : position;
+                Node left = tree_.load(pointers[separator]);
+                Node right = tree_.load(pointers[separator + 1]);
+                Node &sibling = position > 0 ? left : right;
+                std::vector<Item> &leftItems = Tree::items(left);
+                std::vector<Item> &rightItems = Tree::items(right);
+                std::vector<uint32_t> &leftPointers = Tree::pointers(left);
+                std::vector<uint32_t> &rightPointers = Tree::pointers(right);
+                const bool linked = tree_.leaf_rows() && leftPointers[0] == 0;
+
+                if (Tree::items(sibling).size() > min_items_)
+                {
+                    if (position > 0)
+                    {
+                        // The last item of the left neighbour moves right
+                        rightPointers.insert(rightPointers.begin(), leftPointers.back());
+                        leftPointers.pop_back();
+                        if (linked)
+                        {
+                            rightItems.insert(rightItems.begin(), std::move(leftItems.back()));
+                            leftItems.pop_back();
+                            items[separator] = tree_.separator(leftItems.back(), rightItems.front());
+                        }
+                        else
+                        {
+                            rightItems.insert(rightItems.begin(), std::move(items[separator]));
+                            items[separator] = std::move(leftItems.back());
+                            leftItems.pop_back();
+                        }
+                    }
+                    else
+                    {
+                        // The first item of the right neighbour moves left
+                        leftPointers.push_back(rightPointers.front());
+                        rightPointers.erase(rightPointers.begin());
+                        if (linked)
+                        {
+                            leftItems.push_back(std::move(rightItems.front()));
+                            rightItems.erase(rightItems.begin());
+                            items[separator] = tree_.separator(leftItems.back(), rightItems.front());
+                        }
+                        else
+                        {
+                            leftItems.push_back(std::move(items[separator]));
+                            items[separator] = std::move(rightItems.front());
+                            rightItems.erase(rightItems.begin());
+                        }
+                    }
+                    write(left);
+                    write(right);
+                    return;
+                }
+
+                // Merge into the left node; a B+tree leaf drops the separator
+                // and takes over the right leaf's place in the chain
+                if (linked)
+                {
+                    uint32_t next = Tree::next_leaf(right);
+                    Tree::link(left, Tree::prev_leaf(left), next);
+                    if (next != 0)
+                    {
+                        tree_.set_prev_leaf(next, Tree::page(left));
+                    }
+                    leftPointers.insert(leftPointers.end(), rightPointers.begin() + 1, rightPointers.end());
+                }
+                else
+                {
+                    leftItems.push_back(std::move(items[separator]));
+                    leftPointers.insert(leftPointers.end(), rightPointers.begin(), rightPointers.end());
+                }
+                std::move(rightItems.begin(), rightItems.end(), std::back_inserter(leftItems));
+                items.erase(items.begin() + static_cast<std::ptrdiff_t>(separator));
+                pointers.erase(pointers.begin() + static_cast<std::ptrdiff_t>(separator) + 1);
+                write(left);
+                free_node(right);
+            }
+
+            // Write the root, first pulling up its only child while it has no
+            // items of its own
+            void collapse_root(Node &root)
+            {
+                while (Tree::items(root).empty() && Tree::pointers(root)[0] != 0)
+                {
+                    Node child = tree_.load(Tree::pointers(root)[0]);
+                    Tree::items(root) = std::move(Tree::items(child));
+                    Tree::pointers(root) = std::move(Tree::pointers(child));
+                    if (tree_.leaf_rows() && Tree::pointers(root)[0] == 0)
+                    {
+                        Tree::link(root, Tree::prev_leaf(child), Tree::next_leaf(child));
+                    }
+                    free_node(child);
+                }
+                write(root);
+            }
+
+            // Save node, freeing the overflow pages it no longer needs
+            void write(Node &node) { detail::write_node(tree_, fsm_, node); }
+
+            void free_node(Node &node)
+            {
+                fsm_.free_page(Tree::page(node));
+                for (uint32_t page : Tree::spare_pages(node))
+                {
+                    fsm_.free_page(page);
+                }
+            }
+
+            // Free every node of a subtree that holds no items
+            void free_subtree(uint32_t page)
+            {
+                Node node = tree_.load(page);
+                for (uint32_t child : Tree::pointers(node))
+                {
+                    if (child != 0)
+                    {
+                        free_subtree(child);
+                    }
+                }
+                free_node(node);
+            }
+
+            const Tree &tree_;
+            storage::FreeSpaceMap &fsm_;
+            size_t min_items_;
+        };
+    } // namespace
+
+    RemoveResult remove(const std::string &db_path, const std::vector<std::unique_ptr<DataType>> &primaryKeys, uint32_t page_size)
+    {
+        TableSchema schema = read_schema(db_path, page_size);
+        return remove(db_path, schema, primaryKeys, page_size);
+    }
+
+    RemoveResult remove(const std::string &db_path, const TableSchema &schema, const std::vector<std::unique_ptr<DataType>> &primaryKeys, uint32_t page_size)
+    {
+        std::optional<size_t> pk = primary_key_index(schema);
+        if (!pk)
+        {
+            return {false, "remove: table has no primary key"};
+        }
+        const Column &pk_col = *schema.columns[*pk];
+        for (const std::unique_ptr<DataType> &key : primaryKeys)
+        {
+            if (!key || key->type_name() != pk_col.default_val()->type_name())
+            {
+                return {false, "remove: key is not a " + pk_col.default_val()->type_name() + " like column " + pk_col.name()};
+            }
+        }
+
+        std::shared_ptr<storage::BufferPool> pool = storage::BufferPool::shared(db_path, page_size);
+        storage::BufferPool::Transaction txn = pool->begin();
+        pool->set_right_edge(*schema.clustered_page_ref, {});
+        storage::FreeSpaceMap &fsm = pool->free_space(*schema.available_pages_ref);
+
+        const ClusteredTree clustered{db_path, schema, page_size, *pk};
+        Remover<ClusteredTree> rows(clustered, fsm, schema.min_length);
+
+        size_t removed = 0;
+        for (const std::unique_ptr<DataType> &key : primaryKeys)
+        {
+            std::optional<DataRow> row;
+            if (!rows.remove(*schema.clustered_page_ref, *key, [&row](DataRow &found)
+                             {
+                                 row = std::move(found);
+                                 return true;
+                             }))
+            {
+                continue;
+            }
+
+            for (const auto &[colIndex, pageRef] : schema.index_page_refs)
+            {
+                remove_posting(db_path, schema, colIndex, row->get(colIndex), row->get(*pk), page_size);
+            }
+            removed++;
+        }
+
+        txn.commit();
+        return {true, "", removed};
+    }
+
+    bool remove_posting(const std::string &db_path, const TableSchema &schema, size_t column, const DataType &value, const DataType &primaryKey, uint32_t page_size)
+    {
+        std::optional<size_t> pk = primary_key_index(schema);
+        if (!pk)
+        {
+            throw std::runtime_error("remove_posting: table has no primary key");
+        }
+        storage::FreeSpaceMap &fsm = storage::BufferPool::shared(db_path, page_size)->free_space(*schema.available_pages_ref);
+        const SecondaryTree index{db_path, schema, page_size, *schema.columns[column], *schema.columns[*pk]};
+
+        // The key leaves the postings of the value; an entry left without
+        // keys leaves the index
+        bool removed = false;
+        Remover<SecondaryTree>(index, fsm, schema.min_length).remove(schema.index_page_refs.at(column), value, [&](IndexEntry &entry)
+                                                                     {
+            std::vector<std::unique_ptr<DataType>> &keys = entry.primary_keys;
+            auto at = std::find_if(keys.begin(), keys.end(), [&primaryKey](const std::unique_ptr<DataType> &k)
+                                   { return *k == primaryKey; });
+            if (at != keys.end())
+            {
+                size_t i = static_cast<size_t>(at - keys.begin());
+                if (i < entry.locators.size())
+                {
+                    entry.locators.erase(entry.locators.begin() + i);
+                }
+                if (i < entry.included.size())
+                {
+                    entry.included.erase(entry.included.begin() + i);
+                }
+                keys.erase(at);
+                removed = true;
+            }
+            return keys.empty(); });
+        return removed;
+    }
+
+} // namespace dbone::remove
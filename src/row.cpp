@@ -1,6 +1,7 @@
 #include "dbone/row.hpp"
 #include "dbone/serialize.hpp"
 #include <iostream>
+#include <algorithm>
 
 void DataRow::set(size_t col, std::unique_ptr<DataType> val)
 {
@@ -17,8 +18,55 @@ const DataType &DataRow::get(size_t col) const
     return *it->second;
 }
 
+DataRow DataRow::key_only() const
+{
+    if (!primaryKeyIndex_)
+    {
+        throw std::runtime_error("Row::key_only - row has no primary key");
+    }
+    DataRow key;
+    key.set(*primaryKeyIndex_, get(*primaryKeyIndex_).clone());
+    key.primaryKeyIndex_ = primaryKeyIndex_;
+    return key;
+}
+
+DataRow DataRow::separator(const DataRow &left, const DataRow &right)
+{
+    DataRow key = right.key_only();
+    if (!left.primaryKeyIndex_ || *left.primaryKeyIndex_ != *right.primaryKeyIndex_)
+    {
+        throw std::runtime_error("Row::separator - rows have different primary keys");
+    }
+    auto low = dynamic_cast<const VarCharType *>(&left.get(*left.primaryKeyIndex_));
+    auto high = dynamic_cast<const VarCharType *>(&right.get(*right.primaryKeyIndex_));
+    if (low && high && low->value() < high->value())
+    {
+        const std::string &l = low->value();
+        const std::string &r = high->value();
+        size_t shared = std::mismatch(l.begin(), l.end(), r.begin(), r.end()).first - l.begin();
+        if (shared + 1 < r.size())
+        {
+            key.set(*key.primaryKeyIndex_, std::make_unique<VarCharType>(r.substr(0, shared + 1), high->max_length()));
+        }
+    }
+    return key;
+}
+
 void DataRow::to_bits(BitBuffer &buf) const
 {
+    size_t key_offset;
+    to_bits(buf, key_offset);
+}
+
+void DataRow::to_bits(BitBuffer &buf, size_t &key_offset) const
+{
+    to_bits(buf, key_offset, 0);
+}
+
+void DataRow::to_bits(BitBuffer &buf, size_t &key_offset, size_t key_prefix) const
+{
+    size_t start = buf.bytes().size();
+    key_offset = NO_KEY;
     buf.putU16(static_cast<uint16_t>(values_.size()));
 
     for (const auto &pair : values_)
@@ -32,6 +80,15 @@ void DataRow::to_bits(BitBuffer &buf) const
         }
 
         buf.putU16(static_cast<uint16_t>(col));
+        if (primaryKeyIndex_ && col == *primaryKeyIndex_)
+        {
+            key_offset = buf.bytes().size() - start;
+            if (key_prefix > 0)
+            {
+                Column::suffix_to_bits(buf, *val, key_prefix);
+                continue;
+            }
+        }
         val->to_bits(buf);
     }
 }
@@ -66,9 +123,17 @@ DataRow DataRow::fromRow(const dbone::insert::Row &row, const TableSchema &schem
     return std::move(dr); // ✅ force move, avoids deleted copy error
 }
 
-DataRow DataRow::bits_to_row(const std::vector<uint8_t> &payload,
+DataRow DataRow::bits_to_row(std::span<const uint8_t> payload,
                              size_t &ref,
                              const TableSchema &schema)
+{
+    return bits_to_row(payload, ref, schema, {});
+}
+
+DataRow DataRow::bits_to_row(std::span<const uint8_t> payload,
+                             size_t &ref,
+                             const TableSchema &schema,
+                             std::string_view key_prefix)
 {
     DataRow dr;
 
@@ -76,12 +141,14 @@ DataRow DataRow::bits_to_row(const std::vector<uint8_t> &payload,
     for (size_t i = 0; i < rowLength; i++)
     {
         uint16_t columnNum = readU16(payload, ref);
-        dr.set(columnNum, schema.columns[columnNum].get()->from_bits(payload, ref));
-        // schema.columns[columnNum].get().;
-        if (schema.columns[columnNum].get()->primaryKey())
+        const Column &column = *schema.columns[columnNum];
+        if (column.primaryKey())
         {
+            dr.set(columnNum, key_prefix.empty() ? column.from_bits(payload, ref) : column.from_suffix_bits(payload, ref, key_prefix));
             dr.primaryKeyIndex_ = columnNum;
+            continue;
         }
+        dr.set(columnNum, column.from_bits(payload, ref));
     }
 
     return dr;
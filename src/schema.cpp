@@ -4,11 +4,13 @@
 #include "dbone/index.hpp"
 #include "dbone/storage.hpp"
 #include "dbone/serialize.hpp"
+#include "dbone/buffer_pool.hpp"
 #include <filesystem>
 #include <cstdio>
 #include <system_error>
 #include <iostream>
 #include <fstream>
+#include <cmath>
 #include <iomanip> // for std::setw, std::setfill
 // using namespace dbone::serialize;
 namespace fs = std::filesystem;
@@ -44,20 +46,18 @@ static void dump_bytes(const std::vector<uint8_t> &buf, size_t off, size_t count
 
 TableSchema read_schema(const std::string &file, uint32_t page_size)
 {
-    std::ifstream in(file, std::ios::binary);
-    if (!in)
-        throw std::runtime_error("Failed to open schema file: " + file);
+    auto pool = dbone::storage::BufferPool::shared(file, page_size);
 
-    // --- Step 1: read first page
-    std::vector<uint8_t> page(page_size);
-    in.read(reinterpret_cast<char *>(page.data()), page.size());
-    if (in.gcount() != static_cast<std::streamsize>(page_size))
-        throw std::runtime_error("Failed to read first schema page");
+    // --- Step 1: pin first page
+    dbone::storage::BufferPool::PageRef page0 = pool->fetch(0);
+    std::span<const uint8_t> page(page0.data(), page_size);
 
     size_t off = 0;
 
     // page_count (1 byte)
     uint8_t page_count = readU8(page, off);
+    if (page_count == 0)
+        throw std::runtime_error("Invalid schema page count");
 
     // page list
     std::vector<uint32_t> page_list;
@@ -71,23 +71,20 @@ TableSchema read_schema(const std::string &file, uint32_t page_size)
     uint64_t header_size = 1ull + 4ull * (page_count - 1);
     if (header_size > page_size)
         throw std::runtime_error("Invalid header size > page size");
-    size_t payload_in_page0 = page_size - static_cast<size_t>(header_size);
 
-    // gather schema payload
-    std::vector<uint8_t> schema_payload;
-    schema_payload.insert(schema_payload.end(),
-                          page.begin() + header_size,
-                          page.begin() + header_size + payload_in_page0);
-
-    // --- Step 3: read additional schema pages if listed
-    for (uint32_t pg : page_list)
+    // --- Step 3: a single-page schema is parsed in place; otherwise gather
+    // the tail of page 0 and every listed page into one buffer
+    std::span<const uint8_t> schema_payload = page.subspan(static_cast<size_t>(header_size));
+    std::vector<uint8_t> assembled;
+    if (!page_list.empty())
     {
-        in.seekg(static_cast<std::streamoff>(pg) * page_size, std::ios::beg);
-        std::vector<uint8_t> buf(page_size);
-        in.read(reinterpret_cast<char *>(buf.data()), buf.size());
-        if (in.gcount() != static_cast<std::streamsize>(page_size))
-            throw std::runtime_error("Failed to read schema page " + std::to_string(pg));
-        schema_payload.insert(schema_payload.end(), buf.begin(), buf.end());
+        assembled.assign(schema_payload.begin(), schema_payload.end());
+        for (uint32_t pg : page_list)
+        {
+            dbone::storage::BufferPool::PageRef buf = pool->fetch(pg);
+            assembled.insert(assembled.end(), buf.data(), buf.data() + page_size);
+        }
+        schema_payload = assembled;
     }
 
     // --- Step 4: parse schema_payload
@@ -129,7 +126,9 @@ TableSchema read_schema(const std::string &file, uint32_t page_size)
             indexColumns.push_back(i);
         }
 
-        uint8_t type_id = packed & 0x0F;
+        bool included = (packed & (1u << 3)) != 0;
+
+        uint8_t type_id = packed & 0x07;
 
         if (type_id == 1)
         { // BIGINT
@@ -138,7 +137,7 @@ TableSchema read_schema(const std::string &file, uint32_t page_size)
                 throw std::runtime_error("BIGINT default out of bounds");
             int64_t def = readI64(schema_payload, off);
             schema.columns.emplace_back(
-                std::make_unique<BigIntColumn>(col_name, nullable, primaryKey, unique, indexed, def));
+                std::make_unique<BigIntColumn>(col_name, nullable, primaryKey, unique, indexed, def, included));
         }
         else if (type_id == 2)
         { // CHAR(N)
@@ -149,7 +148,7 @@ TableSchema read_schema(const std::string &file, uint32_t page_size)
             std::string def(reinterpret_cast<const char *>(&schema_payload[off]), len);
             off += len;
             schema.columns.emplace_back(
-                std::make_unique<CharColumn>(col_name, len, nullable, primaryKey, unique, indexed, def));
+                std::make_unique<CharColumn>(col_name, len, nullable, primaryKey, unique, indexed, def, included));
         }
         else if (type_id == 3)
         {
@@ -176,7 +175,7 @@ TableSchema read_schema(const std::string &file, uint32_t page_size)
             off += def_len;
 
             schema.columns.emplace_back(
-                std::make_unique<VarCharColumn>(col_name, max_length, nullable, primaryKey, unique, indexed, def));
+                std::make_unique<VarCharColumn>(col_name, max_length, nullable, primaryKey, unique, indexed, def, included));
         }
         else
         {
@@ -191,6 +190,14 @@ TableSchema read_schema(const std::string &file, uint32_t page_size)
         schema.index_page_refs[indexColumns[i]] = val;
     }
 
+    // Layout flags; files written before they existed end with zeros here
+    if (off < schema_payload.size())
+    {
+        uint8_t layout = readU8(schema_payload, off);
+        schema.bplus_tree = (layout & 1u) != 0;
+        schema.index_locators = (layout & 2u) != 0;
+    }
+
     return schema;
 }
 
@@ -275,7 +282,7 @@ bool create_table(const TableSchema &s,
     // --- 2) Compute how many pages are required
     auto capacity_for_pages = [page_size](uint32_t N, uint32_t numberOfIndexes) -> int64_t
     {
-        int64_t header = 1 + 4LL * (N > 0 ? (N - 1) : 0) + 8 + 4 * numberOfIndexes;
+        int64_t header = 1 + 4LL * (N > 0 ? (N - 1) : 0) + 8 + 4 * numberOfIndexes + 1;
         if (header > page_size)
             return -1;
         return static_cast<int64_t>(N) * page_size - header;
@@ -343,10 +350,21 @@ bool create_table(const TableSchema &s,
         }
     }
 
+    // layout flags (u8)
+    payload.push_back(uint8_t((s.bplus_tree ? 1 : 0) | (s.index_locators ? 2 : 0)));
+
     const uint64_t payload_size = payload.size();
     LOG("payload size=%llu bytes", (unsigned long long)payload_size);
 
     // --- 4) Create file and size it
+    // Any cached pages (or unreplayed log) for a previous file at this path
+    // are now stale.
+    dbone::storage::BufferPool::release(out_path.string());
+    {
+        std::error_code ec;
+        fs::remove(dbone::storage::WriteAheadLog::path_for(out_path.string()), ec);
+    }
+
     FILE *f = std::fopen(out_path.string().c_str(), "wb+");
     if (!f)
     {
@@ -1,7 +1,151 @@
 #include "dbone/search.hpp"
 #include "dbone/clustered_index_node.hpp"
 #include "dbone/secondary_index_node.hpp"
+#include "dbone/buffer_pool.hpp"
+#include "dbone/key_search.hpp"
 #include <chrono>
+#include <algorithm>
+
+// Load the children a scan of [lo, hi] will descend into (either bound may
+// be null) in one batch, so the recursive loads below find them cached
+// instead of each waiting on its own read.
+static void prefetchChildren(const std::string &db_path, uint32_t page_size, const std::vector<DataRow> &items,
+                             const std::vector<uint32_t> &pagePointers, size_t columnIndex, const DataType *lo,
+                             const DataType *hi)
+{
+    std::vector<uint32_t> children;
+    for (size_t i = 0; i < pagePointers.size(); i++)
+    {
+        if (pagePointers[i] == 0)
+            continue;
+        if (lo && i < items.size() && !(items[i].get(columnIndex) > *lo))
+            continue;
+        if (hi && i > 0 && !(items[i - 1].get(columnIndex) < *hi))
+            continue;
+        children.push_back(pagePointers[i]);
+    }
+    if (children.size() > 1)
+    {
+        dbone::storage::BufferPool::shared(db_path, page_size)->prefetch(children);
+    }
+}
+
+// Same, for the children first..last of a node read through a view
+static void prefetchChildren(const std::string &db_path, uint32_t page_size, const ClusteredIndexNodeView &node,
+                             size_t first, size_t last)
+{
+    std::vector<uint32_t> children;
+    for (size_t i = first; i <= last && i <= node.size(); i++)
+    {
+        if (node.pointer(i) != 0)
+            children.push_back(node.pointer(i));
+    }
+    if (children.size() > 1)
+    {
+        dbone::storage::BufferPool::shared(db_path, page_size)->prefetch(children);
+    }
+}
+
+// B+tree: the leaf that holds key, or the leftmost leaf with key null.
+// A separator equal to the key sends the descent right.
+static ClusteredIndexNodeView findLeaf(const std::string &db_path, const TableSchema &schema, uint32_t page,
+                                       const DataType *key, uint32_t page_size)
+{
+    ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, page, schema, page_size);
+    while (node.pointer(0) != 0)
+    {
+        size_t i = 0;
+        if (key)
+        {
+            i = node.lower_bound(*key);
+            if (i < node.size() && node.compare_key(i, *key) == 0)
+                i++;
+        }
+        node = ClusteredIndexNodeView::load(db_path, node.pointer(i), schema, page_size);
+    }
+    return node;
+}
+
+// B+tree range scan: one descent to the leaf holding the lower bound, then
+// along the leaf links until the upper bound. Either bound may be null.
+static SearchResult scanLeaves(const std::string &db_path, const TableSchema &schema, uint32_t root,
+                               const DataType *lo, bool loInclusive, const DataType *hi, bool hiInclusive,
+                               uint32_t page_size)
+{
+    SearchResult result;
+    ClusteredIndexNodeView leaf = findLeaf(db_path, schema, root, lo, page_size);
+    size_t i = 0;
+    if (lo)
+    {
+        i = leaf.lower_bound(*lo);
+        if (!loInclusive && i < leaf.size() && leaf.compare_key(i, *lo) == 0)
+            i++;
+    }
+    while (true)
+    {
+        for (; i < leaf.size(); i++)
+        {
+            if (hi)
+            {
+                int cmp = leaf.compare_key(i, *hi);
+                if (cmp > 0 || (cmp == 0 && !hiInclusive))
+                    return result;
+            }
+            result.rows.push_back(leaf.row(i).toRow(schema));
+        }
+        // Stop at the last leaf, or one that ends at the upper bound
+        if (leaf.next_leaf() == 0 || (hi && leaf.size() > 0 && leaf.compare_key(leaf.size() - 1, *hi) >= 0))
+            return result;
+        leaf = ClusteredIndexNodeView::load(db_path, leaf.next_leaf(), schema, page_size);
+        i = 0;
+    }
+}
+
+// B+tree lookup of the sorted keys [offset, end): each node sends the keys
+// below a separator to the child left of it, so every node on the way is
+// read once however many keys pass through it.
+static void searchLeafKeys(const std::string &db_path, const TableSchema &schema, uint32_t page,
+                           std::vector<std::unique_ptr<DataType>> &primaryKeys, size_t offset, size_t end,
+                           uint32_t page_size, std::vector<dbone::insert::Row> &rows)
+{
+    ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, page, schema, page_size);
+    if (node.pointer(0) == 0)
+    {
+        for (size_t k = offset; k < end; k++)
+        {
+            size_t i = node.lower_bound(*primaryKeys[k]);
+            if (i < node.size() && node.compare_key(i, *primaryKeys[k]) == 0)
+                rows.push_back(node.row(i).toRow(schema));
+        }
+        return;
+    }
+
+    // (child, first key past its share)
+    std::vector<std::pair<size_t, size_t>> shares;
+    size_t k = offset;
+    for (size_t i = 0; i <= node.size() && k < end; i++)
+    {
+        size_t first = k;
+        while (k < end && (i == node.size() || node.compare_key(i, *primaryKeys[k]) > 0))
+            k++;
+        if (k > first)
+            shares.emplace_back(i, k);
+    }
+    if (shares.size() > 1)
+    {
+        std::vector<uint32_t> children;
+        for (const auto &[child, stop] : shares)
+            children.push_back(node.pointer(child));
+        dbone::storage::BufferPool::shared(db_path, page_size)->prefetch(children);
+    }
+
+    size_t first = offset;
+    for (const auto &[child, stop] : shares)
+    {
+        searchLeafKeys(db_path, schema, node.pointer(child), primaryKeys, first, stop, page_size, rows);
+        first = stop;
+    }
+}
 
 SearchResult searchMultiPrimaryKeys(
     const std::string &db_path,
@@ -11,24 +155,24 @@ SearchResult searchMultiPrimaryKeys(
     uint32_t page_size,
     size_t &offset)
 {
-    size_t primaryColumnIndex = static_cast<size_t>(-1);
-    for (size_t i = 0; i < schema.columns.size(); i++)
+    if (!primary_key_index(schema))
     {
-        if (schema.columns[i]->primaryKey())
-        {
-            primaryColumnIndex = i;
-            break;
-        }
+        throw std::runtime_error("Can't find primary column index. [searchPrimaryKeys]");
     }
-    if (primaryColumnIndex == static_cast<size_t>(-1))
+
+    if (schema.bplus_tree)
     {
-        throw std::runtime_error("Can't find primary column index. [searchPrimaryKeys]");
+        SearchResult searchResult;
+        if (offset < primaryKeys.size())
+        {
+            searchLeafKeys(db_path, schema, currentPage, primaryKeys, offset, primaryKeys.size(), page_size, searchResult.rows);
+            offset = primaryKeys.size();
+        }
+        return searchResult;
     }
 
-    ClusteredIndexNode clusteredIndexNode =
-        ClusteredIndexNode::load(db_path, currentPage, schema, page_size);
-    std::vector<DataRow> &items = clusteredIndexNode.get_items();
-    std::vector<uint32_t> &pagePointers = clusteredIndexNode.get_page_pointers();
+    // Keys are compared in the page buffer; only matching rows are decoded.
+    ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, currentPage, schema, page_size);
 
     SearchResult searchResult;
 
@@ -37,17 +181,40 @@ SearchResult searchMultiPrimaryKeys(
         return searchResult; // done already
     }
 
-    for (size_t i = 0; i < items.size() && offset < primaryKeys.size(); i++)
+    // Children some remaining key falls into, fetched as one batch.
+    if (node.pointer(0) != 0)
     {
-        const DataType &val = items[i].get(primaryColumnIndex);
-        const DataType &target = *primaryKeys[offset];
+        std::vector<uint32_t> children;
+        size_t k = offset;
+        for (size_t i = 0; i < node.size() && k < primaryKeys.size(); i++)
+        {
+            if (node.compare_key(i, *primaryKeys[k]) > 0)
+            {
+                children.push_back(node.pointer(i));
+                while (k < primaryKeys.size() && node.compare_key(i, *primaryKeys[k]) > 0)
+                    k++;
+            }
+            if (k < primaryKeys.size() && node.compare_key(i, *primaryKeys[k]) == 0)
+                k++;
+        }
+        if (k < primaryKeys.size())
+            children.push_back(node.pointer(node.size()));
+        if (children.size() > 1)
+        {
+            dbone::storage::BufferPool::shared(db_path, page_size)->prefetch(children);
+        }
+    }
 
-        if (val > target)
+    for (size_t i = 0; i < node.size() && offset < primaryKeys.size(); i++)
+    {
+        int cmp = node.compare_key(i, *primaryKeys[offset]);
+
+        if (cmp > 0)
         {
-            if (pagePointers[i] != 0)
+            if (node.pointer(i) != 0)
             {
                 SearchResult result =
-                    searchMultiPrimaryKeys(db_path, schema, pagePointers[i],
+                    searchMultiPrimaryKeys(db_path, schema, node.pointer(i),
                                            primaryKeys, page_size, offset);
                 searchResult.rows.insert(searchResult.rows.end(),
                                          std::make_move_iterator(result.rows.begin()),
@@ -59,9 +226,9 @@ SearchResult searchMultiPrimaryKeys(
             }
         }
 
-        if (offset < primaryKeys.size() && val == *primaryKeys[offset])
+        if (offset < primaryKeys.size() && node.compare_key(i, *primaryKeys[offset]) == 0)
         {
-            searchResult.rows.push_back(items[i].toRow(schema));
+            searchResult.rows.push_back(node.row(i).toRow(schema));
             offset++;
             if (offset == primaryKeys.size())
             {
@@ -71,10 +238,10 @@ SearchResult searchMultiPrimaryKeys(
     }
 
     // recurse into rightmost child if still have keys
-    if (offset < primaryKeys.size() && pagePointers[items.size()] != 0)
+    if (offset < primaryKeys.size() && node.pointer(node.size()) != 0)
     {
         SearchResult result =
-            searchMultiPrimaryKeys(db_path, schema, pagePointers[items.size()],
+            searchMultiPrimaryKeys(db_path, schema, node.pointer(node.size()),
                                    primaryKeys, page_size, offset);
         searchResult.rows.insert(searchResult.rows.end(),
                                  std::make_move_iterator(result.rows.begin()),
@@ -86,11 +253,14 @@ SearchResult searchMultiPrimaryKeys(
 
 SearchResult dbone::search::searchPrimaryKeys(const std::string &db_path, std::vector<std::unique_ptr<DataType>> &primaryKeys, uint32_t page_size)
 {
-    auto start = std::chrono::high_resolution_clock::now();
+    TableSchema schema(read_schema(db_path, page_size));
+    return searchPrimaryKeys(db_path, schema, primaryKeys, page_size);
+}
 
-    std::vector<dbone::insert::Row> rows;
+SearchResult dbone::search::searchPrimaryKeys(const std::string &db_path, const TableSchema &schema, std::vector<std::unique_ptr<DataType>> &primaryKeys, uint32_t page_size)
+{
+    auto start = std::chrono::high_resolution_clock::now();
 
-    TableSchema schema(read_schema(db_path, page_size));
     size_t offset = 0;
     SearchResult result = searchMultiPrimaryKeys(db_path, schema, *schema.clustered_page_ref, primaryKeys, page_size, offset);
 
@@ -102,191 +272,160 @@ SearchResult dbone::search::searchPrimaryKeys(const std::string &db_path, std::v
 
 SearchResult searchPrimaryKey(const std::string &db_path, const TableSchema &schema, uint32_t currentPage, const SearchParam &param, uint32_t page_size)
 { // from clustered index (as primary key)
-    ClusteredIndexNode clusteredIndexNode = ClusteredIndexNode::load(db_path, currentPage, schema, page_size);
-    std::vector<DataRow> &items = clusteredIndexNode.get_items();
+    if (schema.bplus_tree)
+    {
+        const DataType *key = param.compareTo.get();
+        const DataType *key2 = param.compareTo2 ? param.compareTo2->get() : nullptr;
+        switch (param.comparator)
+        {
+        case Comparator::Equal:
+        {
+            SearchResult result;
+            ClusteredIndexNodeView leaf = findLeaf(db_path, schema, currentPage, key, page_size);
+            size_t i = leaf.lower_bound(*key);
+            if (i < leaf.size() && leaf.compare_key(i, *key) == 0)
+                result.rows.push_back(leaf.row(i).toRow(schema));
+            return result;
+        }
+        case Comparator::Less:
+            return scanLeaves(db_path, schema, currentPage, nullptr, false, key, false, page_size);
+        case Comparator::LessEqual:
+            return scanLeaves(db_path, schema, currentPage, nullptr, false, key, true, page_size);
+        case Comparator::Greater:
+            return scanLeaves(db_path, schema, currentPage, key, false, nullptr, false, page_size);
+        case Comparator::GreaterEqual:
+            return scanLeaves(db_path, schema, currentPage, key, true, nullptr, false, page_size);
+        case Comparator::EqualNon:
+            return scanLeaves(db_path, schema, currentPage, key, true, key2, false, page_size);
+        case Comparator::NonEqual:
+            return scanLeaves(db_path, schema, currentPage, key, false, key2, true, page_size);
+        case Comparator::NonNon:
+            return scanLeaves(db_path, schema, currentPage, key, false, key2, false, page_size);
+        case Comparator::EqualEqual:
+            return scanLeaves(db_path, schema, currentPage, key, true, key2, true, page_size);
+        }
+        return SearchResult();
+    }
 
     if (param.comparator == Comparator::Equal)
     {
-        for (size_t i = 0; i < items.size(); i++)
+        // Binary-search each node's keys in place and decode only the
+        // matching row.
+        uint32_t page = currentPage;
+        while (page != 0)
         {
-            if (items[i].get(*param.columnIndex) > *param.compareTo)
-            {
-                if (clusteredIndexNode.get_page_pointers()[i] == 0)
-                {
-                    return SearchResult();
-                }
-                return searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-            }
-            else if (items[i].get(*param.columnIndex) == *param.compareTo)
+            ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, page, schema, page_size);
+            size_t i = node.lower_bound(*param.compareTo);
+            if (i < node.size() && node.compare_key(i, *param.compareTo) == 0)
             {
                 SearchResult result;
-                std::vector<dbone::insert::Row> rows;
-                dbone::insert::Row row = items[i].toRow(schema);
-                rows.push_back(row);
-                result.rows = rows;
+                result.rows.push_back(node.row(i).toRow(schema));
                 return result;
             }
+            page = node.pointer(i);
         }
+        return SearchResult();
+    }
 
-        if (clusteredIndexNode.get_page_pointers()[items.size()] == 0)
+    // The bounds are located by binary search over the keys in place; only
+    // rows inside the range are decoded.
+    ClusteredIndexNodeView node = ClusteredIndexNodeView::load(db_path, currentPage, schema, page_size);
+    size_t lower = node.lower_bound(*param.compareTo);
+    bool lowerEqual = lower < node.size() && node.compare_key(lower, *param.compareTo) == 0;
+
+    auto descend = [&](size_t i, SearchResult &currentResult)
+    {
+        if (node.pointer(i) != 0)
         {
-            return SearchResult();
+            SearchResult result = searchPrimaryKey(db_path, schema, node.pointer(i), param, page_size);
+            currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
         }
-        return searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[items.size()], param, page_size);
-    }
-    else if (param.comparator == Comparator::Less || param.comparator == Comparator::LessEqual)
+    };
+
+    if (param.comparator == Comparator::Less || param.comparator == Comparator::LessEqual)
     {
+        prefetchChildren(db_path, page_size, node, 0, lower);
         SearchResult currentResult;
-        bool end = false;
-        for (size_t i = 0; i < items.size(); i++)
+        for (size_t i = 0; i < lower; i++)
         {
-            if (items[i].get(*param.columnIndex) < *param.compareTo)
-            {
-                if (clusteredIndexNode.get_page_pointers()[i] != 0)
-                {
-                    SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-                    currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-                }
-                dbone::insert::Row row = items[i].toRow(schema);
-                currentResult.rows.push_back(row);
-            }
-            else if (items[i].get(*param.columnIndex) == *param.compareTo)
-            {
-                if (clusteredIndexNode.get_page_pointers()[i] != 0)
-                {
-                    SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-                    currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-                }
-                if (param.comparator == Comparator::LessEqual)
-                {
-                    dbone::insert::Row row = items[i].toRow(schema);
-                    currentResult.rows.push_back(row);
-                }
-            }
-            else
-            {
-                if (clusteredIndexNode.get_page_pointers()[i] != 0)
-                {
-                    SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-                    currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-                }
-                end = true;
-                break;
-            }
+            descend(i, currentResult);
+            currentResult.rows.push_back(node.row(i).toRow(schema));
         }
-        if (!end)
+        // Child left of the bound holds the rest of the keys below it
+        descend(lower, currentResult);
+        if (lowerEqual && param.comparator == Comparator::LessEqual)
         {
-            if (clusteredIndexNode.get_page_pointers()[items.size()] != 0)
-            {
-                SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[items.size()], param, page_size);
-                currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-            }
+            currentResult.rows.push_back(node.row(lower).toRow(schema));
         }
         return currentResult;
     }
     else if (param.comparator == Comparator::Greater || param.comparator == Comparator::GreaterEqual)
     {
+        size_t first = lower;
         SearchResult currentResult;
-        for (size_t i = 0; i < items.size(); i++)
+        if (lowerEqual)
         {
-            if (items[i].get(*param.columnIndex) == *param.compareTo)
+            if (param.comparator == Comparator::GreaterEqual)
             {
-                if (param.comparator == Comparator::GreaterEqual)
-                {
-                    dbone::insert::Row row = items[i].toRow(schema);
-                    currentResult.rows.push_back(row);
-                }
-            }
-            else if (items[i].get(*param.columnIndex) > *param.compareTo)
-            {
-                if (clusteredIndexNode.get_page_pointers()[i] != 0)
-                {
-                    SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-                    currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-                }
-                dbone::insert::Row row = items[i].toRow(schema);
-                currentResult.rows.push_back(row);
+                currentResult.rows.push_back(node.row(lower).toRow(schema));
             }
+            first++;
         }
-        if (clusteredIndexNode.get_page_pointers()[items.size()] != 0)
+        prefetchChildren(db_path, page_size, node, first, node.size());
+        for (size_t i = first; i < node.size(); i++)
         {
-            SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[items.size()], param, page_size);
-            currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
+            descend(i, currentResult);
+            currentResult.rows.push_back(node.row(i).toRow(schema));
         }
+        descend(node.size(), currentResult);
         return currentResult;
     }
     else if (param.comparator == Comparator::EqualNon || param.comparator == Comparator::NonEqual || param.comparator == Comparator::NonNon || param.comparator == Comparator::EqualEqual)
     {
+        const DataType &upperKey = **param.compareTo2;
+        size_t upper = node.lower_bound(upperKey);
+        prefetchChildren(db_path, page_size, node, lowerEqual ? lower + 1 : lower, std::min(upper, node.size()));
         SearchResult currentResult;
         bool finished = false;
-        for (size_t i = 0; i < items.size(); i++)
+        for (size_t i = lower; i < node.size(); i++)
         {
-            if (items[i].get(*param.columnIndex) == *param.compareTo)
+            if (i == lower && lowerEqual)
             {
                 if (param.comparator == Comparator::EqualNon || param.comparator == Comparator::EqualEqual)
                 {
-                    dbone::insert::Row row = items[i].toRow(schema);
-                    currentResult.rows.push_back(row);
+                    currentResult.rows.push_back(node.row(i).toRow(schema));
                 }
-                // if (clusteredIndexNode.get_page_pointers()[i] != 0)
-                // {
-                //     SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-                //     currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-                // }
             }
-            else if (items[i].get(*param.columnIndex) > *param.compareTo)
+            else if (i < upper)
+            {
+                // in range - add
+                currentResult.rows.push_back(node.row(i).toRow(schema));
+                descend(i, currentResult);
+            }
+            else
             {
-                if (items[i].get(*param.columnIndex) < **param.compareTo2)
+                if (node.compare_key(i, upperKey) == 0)
                 {
-                    // in range - add
-                    dbone::insert::Row row = items[i].toRow(schema);
-                    currentResult.rows.push_back(row);
-
-                    if (clusteredIndexNode.get_page_pointers()[i] != 0)
+                    // ends equal
+                    if (param.comparator == Comparator::NonEqual || param.comparator == Comparator::EqualEqual)
                     {
-                        SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-                        currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
+                        currentResult.rows.push_back(node.row(i).toRow(schema));
                     }
+                    descend(i, currentResult);
                 }
                 else
                 {
-                    if (items[i].get(*param.columnIndex) == **param.compareTo2)
-                    {
-                        // ends equal
-                        if (param.comparator == Comparator::NonEqual || param.comparator == Comparator::EqualEqual)
-                        {
-                            dbone::insert::Row row = items[i].toRow(schema);
-                            currentResult.rows.push_back(row);
-                        }
-
-                        if (clusteredIndexNode.get_page_pointers()[i] != 0)
-                        {
-                            SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-                            currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-                        }
-                    }
-                    else
-                    {
-                        if (clusteredIndexNode.get_page_pointers()[i] != 0)
-                        {
-                            SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[i], param, page_size);
-                            currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-                        }
-                        // over
-                        finished = true;
-                        break;
-                    }
+                    descend(i, currentResult);
+                    // over
+                    finished = true;
+                    break;
                 }
             }
         }
 
         if (!finished)
         {
-            if (clusteredIndexNode.get_page_pointers()[items.size()] != 0)
-            {
-                SearchResult result = searchPrimaryKey(db_path, schema, clusteredIndexNode.get_page_pointers()[items.size()], param, page_size);
-                currentResult.rows.insert(currentResult.rows.end(), result.rows.begin(), result.rows.end());
-            }
+            descend(node.size(), currentResult);
         }
         return currentResult;
     }
@@ -294,6 +433,34 @@ SearchResult searchPrimaryKey(const std::string &db_path, const TableSchema &sch
     return SearchResult();
 }
 
+// Whether a column value satisfies the comparison of param
+static bool matches(const DataType &cell, const SearchParam &param)
+{
+    const DataType &compareVal = *param.compareTo;
+    switch (param.comparator)
+    {
+    case Comparator::Less:
+        return cell < compareVal;
+    case Comparator::LessEqual:
+        return cell <= compareVal;
+    case Comparator::Greater:
+        return cell > compareVal;
+    case Comparator::GreaterEqual:
+        return cell >= compareVal;
+    case Comparator::Equal:
+        return cell == compareVal;
+    case Comparator::EqualEqual:
+        return cell <= **param.compareTo2 && cell >= compareVal;
+    case Comparator::NonNon:
+        return cell < **param.compareTo2 && cell > compareVal;
+    case Comparator::EqualNon:
+        return cell < **param.compareTo2 && cell >= compareVal;
+    case Comparator::NonEqual:
+        return cell <= **param.compareTo2 && cell > compareVal;
+    }
+    return false;
+}
+
 static void searchNonIndexedAcc(
     const std::string &db_path,
     const TableSchema &schema,
@@ -308,75 +475,13 @@ static void searchNonIndexedAcc(
 
     std::vector<DataRow> &items = clusteredIndexNode.get_items();
     std::vector<uint32_t> &pagePointers = clusteredIndexNode.get_page_pointers();
-
-    const DataType &compareVal = *param.compareTo;
+    prefetchChildren(db_path, page_size, items, pagePointers, 0, nullptr, nullptr); // full scan
 
     for (size_t i = 0; i < items.size(); ++i)
     {
-        const DataType &cell = items[i].get(*param.columnIndex);
-
-        if (param.comparator == Comparator::Less)
-        {
-            if (cell < compareVal)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
-        }
-        else if (param.comparator == Comparator::LessEqual)
-        {
-            if (cell <= compareVal)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
-        }
-        else if (param.comparator == Comparator::Greater)
-        {
-            if (cell > compareVal)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
-        }
-        else if (param.comparator == Comparator::GreaterEqual)
-        {
-            if (cell >= compareVal)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
-        }
-        else if (param.comparator == Comparator::Equal)
+        if (matches(items[i].get(*param.columnIndex), param))
         {
-            if (cell == compareVal)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
-        }
-        else if (param.comparator == Comparator::EqualEqual)
-        {
-            if (cell <= **param.compareTo2 && cell >= *param.compareTo)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
-        }
-        else if (param.comparator == Comparator::NonNon)
-        {
-            if (cell < **param.compareTo2 && cell > *param.compareTo)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
-        }
-        else if (param.comparator == Comparator::EqualNon)
-        {
-            if (cell < **param.compareTo2 && cell >= *param.compareTo)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
-        }
-        else if (param.comparator == Comparator::NonEqual)
-        {
-            if (cell <= **param.compareTo2 && cell > *param.compareTo)
-            {
-                outRows.emplace_back(items[i].toRow(schema));
-            }
+            outRows.emplace_back(items[i].toRow(schema));
         }
 
         if (pagePointers[i] != 0)
@@ -400,20 +505,80 @@ SearchResult searchNonIndexed(
     uint32_t page_size)
 {
     SearchResult result;
+    if (schema.bplus_tree)
+    {
+        // Only the leaves hold rows: walk them from the leftmost one
+        ClusteredIndexNodeView leaf = findLeaf(db_path, schema, currentPage, nullptr, page_size);
+        while (true)
+        {
+            for (size_t i = 0; i < leaf.size(); i++)
+            {
+                DataRow row = leaf.row(i);
+                if (matches(row.get(*param.columnIndex), param))
+                {
+                    result.rows.emplace_back(row.toRow(schema));
+                }
+            }
+            if (leaf.next_leaf() == 0)
+                return result;
+            leaf = ClusteredIndexNodeView::load(db_path, leaf.next_leaf(), schema, page_size);
+        }
+    }
+
     // result.rows.reserve(40000); // pre-allocate some space to reduce growth
     searchNonIndexedAcc(db_path, schema, currentPage, param, page_size, result.rows);
     return result;
 }
 
-static void searchIndexedAcc(const std::string &db_path, const TableSchema &schema, uint32_t currentPage, const SearchParam &param, const Column &indexed_col, const Column &pk_col, uint32_t page_size, std::vector<std::unique_ptr<DataType>> &outKeys)
+// Primary keys found in a secondary index, and with schema.index_locators
+// the clustered page each row was written to. A covering search also takes
+// each key's indexed value and included values.
+struct Postings
+{
+    std::vector<std::unique_ptr<DataType>> keys;
+    std::vector<uint32_t> pages;
+    bool covering = false;
+    std::vector<std::unique_ptr<DataType>> values;
+    std::vector<std::vector<std::unique_ptr<DataType>>> included;
+};
+
+static void takePostings(IndexEntry &entry, const TableSchema &schema, Postings &out)
+{
+    for (size_t k = 0; k < entry.primary_keys.size(); k++)
+    {
+        out.keys.push_back(std::move(entry.primary_keys[k]));
+        if (schema.index_locators)
+            out.pages.push_back(entry.locator(k));
+        if (out.covering)
+        {
+            out.values.push_back(entry.value->clone());
+            out.included.push_back(k < entry.included.size() ? std::move(entry.included[k]) : std::vector<std::unique_ptr<DataType>>());
+        }
+    }
+}
+
+// Positions of postings.keys in key order
+static std::vector<size_t> keyOrder(const Postings &postings)
+{
+    std::vector<size_t> order(postings.keys.size());
+    for (size_t k = 0; k < order.size(); k++)
+        order[k] = k;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+              { return *postings.keys[a] < *postings.keys[b]; });
+    return order;
+}
+
+static void searchIndexedAcc(const std::string &db_path, const TableSchema &schema, uint32_t currentPage, const SearchParam &param, const Column &indexed_col, const Column &pk_col, uint32_t page_size, Postings &outKeys)
 {
     SecondaryIndexNode secondaryIndexNode = SecondaryIndexNode::load(db_path, currentPage, schema, indexed_col, pk_col, page_size);
-    std::vector<IndexEntry> entries = secondaryIndexNode.entries();
+    std::vector<IndexEntry> &entries = secondaryIndexNode.entries();
     // std::cout << "ENTRY SIZE: " << entries.size() << std::endl;
     bool checkEnd = true;
+    // Entries before this are all below the probe value
+    size_t lower = dbone::lower_bound_key(entries.size(), *param.compareTo, [&](size_t i) -> const DataType & { return *entries[i].value; });
     if (param.comparator == Comparator::Equal)
     {
-        for (size_t i = 0; i < entries.size(); i++)
+        for (size_t i = lower; i < entries.size(); i++)
         {
             // std::cout << i << ": " << entries[i].value.get()->default_value_str() << std::endl;
             if (*entries[i].value > *param.compareTo)
@@ -433,10 +598,7 @@ static void searchIndexedAcc(const std::string &db_path, const TableSchema &sche
             {
                 if (secondaryIndexNode.page_pointers()[i] != 0)
                     searchIndexedAcc(db_path, schema, secondaryIndexNode.page_pointers()[i], param, indexed_col, pk_col, page_size, outKeys);
-                for (auto &key : entries[i].primary_keys)
-                {
-                    outKeys.push_back(std::move(key));
-                }
+                takePostings(entries[i], schema, outKeys);
             }
         }
         if (checkEnd)
@@ -447,27 +609,32 @@ static void searchIndexedAcc(const std::string &db_path, const TableSchema &sche
     }
     else if (param.comparator == Comparator::Less || param.comparator == Comparator::LessEqual)
     {
-        for (size_t i = 0; i < entries.size(); i++)
+        std::vector<uint32_t> children;
+        for (size_t i = 0; i < secondaryIndexNode.page_pointers().size(); i++)
         {
-            if (*entries[i].value < *param.compareTo)
-            {
-                if (secondaryIndexNode.page_pointers()[i] != 0)
-                    searchIndexedAcc(db_path, schema, secondaryIndexNode.page_pointers()[i], param, indexed_col, pk_col, page_size, outKeys);
-                for (auto &key : entries[i].primary_keys)
-                {
-                    outKeys.push_back(std::move(key));
-                }
-            }
-            else if (*entries[i].value == *param.compareTo)
+            if (secondaryIndexNode.page_pointers()[i] != 0 && i <= lower)
+                children.push_back(secondaryIndexNode.page_pointers()[i]);
+        }
+        if (children.size() > 1)
+        {
+            dbone::storage::BufferPool::shared(db_path, page_size)->prefetch(children);
+        }
+
+        for (size_t i = 0; i < lower; i++)
+        {
+            if (secondaryIndexNode.page_pointers()[i] != 0)
+                searchIndexedAcc(db_path, schema, secondaryIndexNode.page_pointers()[i], param, indexed_col, pk_col, page_size, outKeys);
+            takePostings(entries[i], schema, outKeys);
+        }
+        for (size_t i = lower; i < entries.size(); i++)
+        {
+            if (*entries[i].value == *param.compareTo)
             {
                 if (secondaryIndexNode.page_pointers()[i] != 0)
                     searchIndexedAcc(db_path, schema, secondaryIndexNode.page_pointers()[i], param, indexed_col, pk_col, page_size, outKeys);
                 if (param.comparator == Comparator::LessEqual)
                 {
-                    for (auto &key : entries[i].primary_keys)
-                    {
-                        outKeys.push_back(std::move(key));
-                    }
+                    takePostings(entries[i], schema, outKeys);
                 }
             }
             else
@@ -489,10 +656,109 @@ static void searchIndexedAcc(const std::string &db_path, const TableSchema &sche
     }
 }
 
-SearchResult searchIndexed(const std::string &db_path, const TableSchema &schema, const Column &indexed_col, const Column &pk_col, const SearchParam &param, size_t index, uint32_t page_size)
+// Rows of postings found through their locators, in primary key order.
+// A locator is a hint: its page may have been split, merged away or reused
+// since, so the row is taken from it only while the page is still a
+// clustered node (a leaf, in a B+tree) holding the key. Keys are unique, so
+// such a hit is the live row. Any other key is looked up from the root.
+static SearchResult searchLocated(const std::string &db_path, const TableSchema &schema, Postings &postings, uint32_t page_size)
+{
+    std::vector<size_t> order = keyOrder(postings);
+
+    std::shared_ptr<dbone::storage::BufferPool> pool = dbone::storage::BufferPool::shared(db_path, page_size);
+    pool->free_space(*schema.available_pages_ref); // loaded here; not held, see is_free()
+    SearchResult result;
+    // Rows written together share a page; keep the last one loaded
+    std::optional<ClusteredIndexNodeView> node;
+    for (size_t k : order)
+    {
+        const DataType &key = *postings.keys[k];
+        uint32_t page = postings.pages[k];
+        if (!node || node->page() != page)
+        {
+            node.reset();
+            // Checked per locator: the map can be dropped by an aborting
+            // writer, and while none is loaded the key takes a descent
+            std::optional<bool> free = page != 0 ? pool->is_free(page) : std::nullopt;
+            if (free && !*free && ClusteredIndexNodeView::is_node(*pool, page))
+            {
+                try
+                {
+                    node = ClusteredIndexNodeView::load(db_path, page, schema, page_size);
+                }
+                catch (const std::exception &)
+                {
+                }
+                if (node && schema.bplus_tree && node->pointer(0) != 0)
+                    node.reset();
+            }
+        }
+        if (node)
+        {
+            size_t i = node->lower_bound(key);
+            if (i < node->size() && node->compare_key(i, key) == 0)
+            {
+                result.rows.push_back(node->row(i).toRow(schema));
+                continue;
+            }
+        }
+
+        std::vector<std::unique_ptr<DataType>> stale;
+        stale.push_back(std::move(postings.keys[k]));
+        size_t offset = 0;
+        SearchResult found = searchMultiPrimaryKeys(db_path, schema, *schema.clustered_page_ref, stale, page_size, offset);
+        result.rows.insert(result.rows.end(), std::make_move_iterator(found.rows.begin()), std::make_move_iterator(found.rows.end()));
+    }
+    return result;
+}
+
+// Rows of a covering search built from the postings alone, in primary key
+// order: the key, the indexed value and the included values
+static SearchResult searchCovered(const TableSchema &schema, const Column &indexed_col, const Column &pk_col, size_t index, Postings &postings)
+{
+    std::vector<size_t> carried = included_columns(schema, index);
+    SearchResult result;
+    result.rows.reserve(postings.keys.size());
+    for (size_t k : keyOrder(postings))
+    {
+        dbone::insert::Row row;
+        row[pk_col.name()] = postings.keys[k]->default_value_str();
+        row[indexed_col.name()] = postings.values[k]->default_value_str();
+        for (size_t i = 0; i < carried.size() && i < postings.included[k].size(); i++)
+            row[schema.columns[carried[i]]->name()] = postings.included[k][i]->default_value_str();
+        result.rows.push_back(std::move(row));
+    }
+    return result;
+}
+
+// columns null means all of them
+SearchResult searchIndexed(const std::string &db_path, const TableSchema &schema, const Column &indexed_col, const Column &pk_col, const SearchParam &param, size_t index, const std::vector<std::string> *columns, uint32_t page_size)
 {
-    std::vector<std::unique_ptr<DataType>> outKeys;
-    searchIndexedAcc(db_path, schema, schema.index_page_refs.at(index), param, indexed_col, pk_col, page_size, outKeys);
+    // The index covers the search when it holds every column asked for
+    std::vector<size_t> carried = included_columns(schema, index);
+    auto covers = [&](const std::string &name)
+    {
+        return name == indexed_col.name() || name == pk_col.name() ||
+               std::any_of(carried.begin(), carried.end(), [&](size_t c)
+                           { return schema.columns[c]->name() == name; });
+    };
+    Postings postings;
+    if (columns)
+        postings.covering = std::all_of(columns->begin(), columns->end(), covers);
+    else
+        postings.covering = std::all_of(schema.columns.begin(), schema.columns.end(), [&](const std::unique_ptr<Column> &col)
+                                        { return covers(col->name()); });
+
+    searchIndexedAcc(db_path, schema, schema.index_page_refs.at(index), param, indexed_col, pk_col, page_size, postings);
+    if (postings.covering)
+    {
+        return searchCovered(schema, indexed_col, pk_col, index, postings);
+    }
+    if (schema.index_locators)
+    {
+        return searchLocated(db_path, schema, postings, page_size);
+    }
+    std::vector<std::unique_ptr<DataType>> &outKeys = postings.keys;
     std::sort(outKeys.begin(), outKeys.end(),
               [](const std::unique_ptr<DataType> &a, const std::unique_ptr<DataType> &b)
               {
@@ -503,20 +769,67 @@ SearchResult searchIndexed(const std::string &db_path, const TableSchema &schema
     return searchMultiPrimaryKeys(db_path, schema, *schema.clustered_page_ref, outKeys, page_size, val);
 }
 
+// Keep only the named columns of each row; columns null keeps them all
+static void project(SearchResult &result, const std::vector<std::string> *columns)
+{
+    if (!columns)
+        return;
+    for (dbone::insert::Row &row : result.rows)
+    {
+        for (auto it = row.begin(); it != row.end();)
+        {
+            if (std::find(columns->begin(), columns->end(), it->first) == columns->end())
+                it = row.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+static SearchResult searchColumns(const std::string &db_path, const TableSchema &schema, const std::vector<SearchParam> &queries, const std::vector<std::string> *projection, uint32_t page_size);
+
 SearchResult dbone::search::searchItem(const std::string &db_path, const std::vector<SearchParam> &queries, uint32_t page_size)
 {
-    auto start = std::chrono::high_resolution_clock::now();
+    TableSchema schema(read_schema(db_path, page_size));
+    return searchItem(db_path, schema, queries, page_size);
+}
 
-    std::vector<dbone::insert::Row> rows;
+SearchResult dbone::search::searchItem(const std::string &db_path, const TableSchema &schema, const std::vector<SearchParam> &queries, uint32_t page_size)
+{
+    return searchColumns(db_path, schema, queries, nullptr, page_size);
+}
 
+SearchResult dbone::search::searchItem(const std::string &db_path, const std::vector<SearchParam> &queries, const std::vector<std::string> &columns, uint32_t page_size)
+{
     TableSchema schema(read_schema(db_path, page_size));
+    return searchItem(db_path, schema, queries, columns, page_size);
+}
+
+SearchResult dbone::search::searchItem(const std::string &db_path, const TableSchema &schema, const std::vector<SearchParam> &queries, const std::vector<std::string> &columns, uint32_t page_size)
+{
+    for (const std::string &name : columns)
+    {
+        if (std::none_of(schema.columns.begin(), schema.columns.end(), [&name](const std::unique_ptr<Column> &col)
+                         { return col->name() == name; }))
+        {
+            throw std::runtime_error("Column '" + name + "' does not exist in table schema");
+        }
+    }
+    return searchColumns(db_path, schema, queries, &columns, page_size);
+}
+
+static SearchResult searchColumns(const std::string &db_path, const TableSchema &schema, const std::vector<SearchParam> &queries, const std::vector<std::string> *projection, uint32_t page_size)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<dbone::insert::Row> rows;
 
     std::unordered_map<uint16_t, std::unique_ptr<Column>> primaryColumns;
 
     auto &columns = schema.columns;
     for (uint16_t i = 0; i < columns.size(); i++)
     {
-        std::unique_ptr<Column> &column = columns[i];
+        const std::unique_ptr<Column> &column = columns[i];
         if (column->primaryKey())
         {
             primaryColumns[i] = column->clone(); // deep copy
@@ -560,6 +873,7 @@ SearchResult dbone::search::searchItem(const std::string &db_path, const std::ve
                 }
 
                 SearchResult result = searchPrimaryKey(db_path, schema, *schema.clustered_page_ref, paramCopy, page_size);
+                project(result, projection);
 
                 auto end = std::chrono::high_resolution_clock::now();
                 auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
@@ -576,8 +890,9 @@ SearchResult dbone::search::searchItem(const std::string &db_path, const std::ve
                 }
                 else
                 {
-                    result = searchIndexed(db_path, schema, *schema.columns[*paramCopy.columnIndex], *column, paramCopy, *paramCopy.columnIndex, page_size);
+                    result = searchIndexed(db_path, schema, *schema.columns[*paramCopy.columnIndex], *column, paramCopy, *paramCopy.columnIndex, projection, page_size);
                 }
+                project(result, projection);
 
                 auto end = std::chrono::high_resolution_clock::now();
                 auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
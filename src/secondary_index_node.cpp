@@ -1,14 +1,36 @@
 #include "dbone/secondary_index_node.hpp"
-#include <fstream>
 #include <filesystem>
 #include <stdexcept>
 #include <algorithm>
-#include "dbone/availablePages.hpp"
+#include "dbone/buffer_pool.hpp"
 #include <dbone/serialize.hpp>
 
 using std::uint32_t;
 using std::uint64_t;
 
+// --------- key and included columns ----------
+std::optional<size_t> primary_key_index(const TableSchema& schema) {
+    for (size_t i = 0; i < schema.columns.size(); ++i) {
+        if (schema.columns[i]->primaryKey()) return i;
+    }
+    return std::nullopt;
+}
+
+std::vector<size_t> included_columns(const TableSchema& schema, size_t indexed) {
+    std::vector<size_t> columns;
+    for (size_t i = 0; i < schema.columns.size(); ++i) {
+        const Column& col = *schema.columns[i];
+        if (col.included() && !col.primaryKey() && i != indexed) columns.push_back(i);
+    }
+    return columns;
+}
+
+std::vector<std::unique_ptr<DataType>> included_values(const TableSchema& schema, size_t indexed, const DataRow& row) {
+    std::vector<std::unique_ptr<DataType>> values;
+    for (size_t col : included_columns(schema, indexed)) values.push_back(row.get(col).clone());
+    return values;
+}
+
 // --------- mutators ----------
 void SecondaryIndexNode::add_entry_at(IndexEntry&& e, size_t pos) {
     if (pos > entries_.size()) throw std::out_of_range("add_entry_at");
@@ -30,16 +52,6 @@ void SecondaryIndexNode::set_available_pages(const std::vector<uint32_t>& pages)
     available_pages_ = pages;
     for (auto p : pages) if (p >= next_new_page_id_) next_new_page_id_ = p + 1;
 }
-void SecondaryIndexNode::set_extra_available_pages(const std::vector<uint32_t>& pages) {
-    extra_available_pages_ = pages;
-}
-
-// --------- file util ----------
-size_t SecondaryIndexNode::num_pages_in_file(const std::string& path, size_t page_size) {
-    namespace fs = std::filesystem;
-    auto file_size = fs::file_size(path);
-    return file_size / page_size;
-}
 
 void SecondaryIndexNode::clear_pointers()
 {
@@ -47,6 +59,43 @@ void SecondaryIndexNode::clear_pointers()
     page_pointers_ = newPtrs;
 }
 
+// --------- key prefixes ----------
+std::string SecondaryIndexNode::common_prefix(bool keys) const {
+    std::string_view prefix;
+    size_t count = 0;
+    auto visit = [&](const DataType& v) {
+        const std::string* chars = Column::key_chars(v);
+        if (!chars) return false;
+        if (count++ == 0) prefix = *chars;
+        else prefix = prefix.substr(0, std::mismatch(prefix.begin(), prefix.end(), chars->begin(), chars->end()).first - prefix.begin());
+        return true;
+    };
+    for (const auto& e : entries_) {
+        if (!keys) {
+            if (!visit(*e.value)) return {};
+            continue;
+        }
+        for (const auto& pk : e.primary_keys) {
+            if (!visit(*pk)) return {};
+        }
+    }
+    if (count < 2) return {};
+    return std::string(prefix.substr(0, std::min<size_t>(prefix.size(), 0xFFFF)));
+}
+
+std::string SecondaryIndexNode::read_prefix(std::span<const uint8_t> payload, size_t& ref) {
+    uint16_t len = readU16(payload, ref);
+    if (ref + len > payload.size()) throw std::runtime_error("SecondaryIndexNode::load: bad key prefix");
+    std::string prefix(reinterpret_cast<const char*>(payload.data() + ref), len);
+    ref += len;
+    return prefix;
+}
+
+void SecondaryIndexNode::write_prefix(BitBuffer& buf, const std::string& prefix) {
+    buf.putU16(static_cast<uint16_t>(prefix.size()));
+    for (char c : prefix) buf.putU8(static_cast<uint8_t>(c));
+}
+
 // --------- load ----------
 SecondaryIndexNode SecondaryIndexNode::load(const std::string& db_path,
                                             uint32_t page_num,
@@ -54,55 +103,23 @@ SecondaryIndexNode SecondaryIndexNode::load(const std::string& db_path,
                                             const Column& indexed_col,
                                             const Column& pk_col,
                                             uint32_t page_size) {
-    std::ifstream in(db_path, std::ios::binary);
-    if (!in) throw std::runtime_error("SecondaryIndexNode::load: open failed");
-
-    const uint64_t offset = uint64_t(page_num) * page_size;
-    in.seekg(offset, std::ios::beg);
-    if (!in) throw std::runtime_error("SecondaryIndexNode::load: seek root failed");
-
-    std::vector<uint8_t> root(page_size);
-    in.read(reinterpret_cast<char*>(root.data()), root.size());
-    if (!in) throw std::runtime_error("SecondaryIndexNode::load: read root failed");
-
-
-    size_t off = 0;
-    uint32_t page_count = readU32(root, off); // number of extra pages after root
-
-    // collect page list
-    std::vector<uint32_t> page_list;
-    page_list.reserve(page_count);
-    for (uint32_t i = 0; i < page_count; ++i) {
-        page_list.push_back(readU32(root, off));
-    }
-
-    // header bytes consumed: 4 + 4*page_count
-    const size_t header_size = 4u + 4u * page_count;
-    if (header_size > page_size) throw std::runtime_error("SecondaryIndexNode::load: header too large");
-
-
-    // gather full payload: tail of root + all subsequent pages
-    std::vector<uint8_t> full_payload;
-    if (header_size < root.size()) {
-        full_payload.insert(full_payload.end(), root.begin() + header_size, root.end());
-    }
-
-    
-
-    for (auto pg : page_list) {
-        std::vector<uint8_t> buf(page_size);
-        const uint64_t pg_off = uint64_t(pg) * page_size;
-        in.seekg(pg_off, std::ios::beg);
-        if (!in) throw std::runtime_error("SecondaryIndexNode::load: seek page failed");
-        in.read(reinterpret_cast<char*>(buf.data()), buf.size());
-        if (!in) throw std::runtime_error("SecondaryIndexNode::load: read page failed");
-        full_payload.insert(full_payload.end(), buf.begin(), buf.end());
-    }
+    auto pool = dbone::storage::BufferPool::shared(db_path, page_size);
 
+    // tail of root + all overflow pages; read in place for single-page nodes
+    dbone::storage::PageChain chain = dbone::storage::read_page_chain(*pool, page_num);
+    std::span<const uint8_t> full_payload = chain.bytes();
+    const std::vector<uint32_t>& page_list = chain.pages();
 
     size_t ref = 0;
 
+    size_t indexed = 0;
+    while (indexed < schema.columns.size() && schema.columns[indexed]->name() != indexed_col.name()) ++indexed;
+    const std::vector<size_t> carried = included_columns(schema, indexed);
+
     // payload format:
+    // [U32 PREFIX_MAGIC, U16 len + value prefix, U16 len + key prefix]
+    //   when the CHAR/VARCHAR values or keys share a prefix; each value
+    //   or key below then leaves its prefix out
     // U32 nEntries
     // U32 left_ptr
     // repeat nEntries times:
@@ -110,9 +127,18 @@ SecondaryIndexNode SecondaryIndexNode::load(const std::string& db_path,
     //   U32 key_count
     //   repeat key_count times:
     //       <pk value>          (DataType via pk_col)
+    //       U32 locator         (only with schema.index_locators)
+    //       <included values>   (DataType each, via included_columns())
     //   U32 right_ptr
 
-    const uint32_t nEntries = readU32(full_payload, ref);
+    uint32_t nEntries = readU32(full_payload, ref);
+    std::string value_prefix;
+    std::string key_prefix;
+    if (nEntries == PREFIX_MAGIC) {
+        value_prefix = read_prefix(full_payload, ref);
+        key_prefix = read_prefix(full_payload, ref);
+        nEntries = readU32(full_payload, ref);
+    }
 
     SecondaryIndexNode node;
     node.set_available_pages(page_list);
@@ -123,13 +149,21 @@ SecondaryIndexNode SecondaryIndexNode::load(const std::string& db_path,
 
     node.entries_.reserve(nEntries);
     for (uint32_t i = 0; i < nEntries; ++i) {
-        auto value = indexed_col.from_bits(full_payload, ref);
+        auto value = value_prefix.empty() ? indexed_col.from_bits(full_payload, ref)
+                                          : indexed_col.from_suffix_bits(full_payload, ref, value_prefix);
 
         uint32_t key_count = readU32(full_payload, ref);
         IndexEntry entry(std::move(value));
         entry.primary_keys.reserve(key_count);
+        if (schema.index_locators) entry.locators.reserve(key_count);
+        if (!carried.empty()) entry.included.reserve(key_count);
         for (uint32_t k = 0; k < key_count; ++k) {
-            entry.primary_keys.push_back(pk_col.from_bits(full_payload, ref));
+            entry.primary_keys.push_back(key_prefix.empty() ? pk_col.from_bits(full_payload, ref)
+                                                            : pk_col.from_suffix_bits(full_payload, ref, key_prefix));
+            if (schema.index_locators) entry.locators.push_back(readU32(full_payload, ref));
+            if (carried.empty()) continue;
+            entry.included.emplace_back();
+            for (size_t col : carried) entry.included.back().push_back(schema.columns[col]->from_bits(full_payload, ref));
         }
 
         node.entries_.push_back(std::move(entry));
@@ -142,10 +176,19 @@ SecondaryIndexNode SecondaryIndexNode::load(const std::string& db_path,
 }
 
 // --------- to_bits ----------
-BitBuffer SecondaryIndexNode::to_bits(const Column& indexed_col, const Column& pk_col) const {
+BitBuffer SecondaryIndexNode::to_bits(const Column& indexed_col, const Column& pk_col, bool locators) const {
     (void)indexed_col; (void)pk_col; // not needed for writing: DataType knows how to serialize itself
     BitBuffer buf;
 
+    // shared prefixes, if any
+    std::string value_prefix = common_prefix(false);
+    std::string key_prefix = common_prefix(true);
+    if (!value_prefix.empty() || !key_prefix.empty()) {
+        buf.putU32(PREFIX_MAGIC);
+        write_prefix(buf, value_prefix);
+        write_prefix(buf, key_prefix);
+    }
+
     // nEntries
     buf.putU32(static_cast<uint32_t>(entries_.size()));
 
@@ -156,14 +199,21 @@ BitBuffer SecondaryIndexNode::to_bits(const Column& indexed_col, const Column& p
     // entries
     for (size_t i = 0; i < entries_.size(); ++i) {
         // value
-        entries_[i].value->to_bits(buf);
+        if (value_prefix.empty()) entries_[i].value->to_bits(buf);
+        else Column::suffix_to_bits(buf, *entries_[i].value, value_prefix.size());
 
         // postings length
         buf.putU32(static_cast<uint32_t>(entries_[i].primary_keys.size()));
 
         // postings
-        for (const auto& pk : entries_[i].primary_keys) {
-            pk->to_bits(buf);
+        const IndexEntry& entry = entries_[i];
+        for (size_t k = 0; k < entry.primary_keys.size(); ++k) {
+            if (key_prefix.empty()) entry.primary_keys[k]->to_bits(buf);
+            else Column::suffix_to_bits(buf, *entry.primary_keys[k], key_prefix.size());
+            if (locators) buf.putU32(entry.locator(k));
+            if (k < entry.included.size()) {
+                for (const auto& v : entry.included[k]) v->to_bits(buf);
+            }
         }
 
         // right pointer for this entry
@@ -181,7 +231,7 @@ std::vector<uint32_t> SecondaryIndexNode::save(const std::string& db_path,
                                                bool do_save) const {
     if (!original_page_) throw std::runtime_error("SecondaryIndexNode::save: original page not set");
 
-    BitBuffer payload = to_bits(*schema.columns.front(), *schema.columns.front()); // columns not used on write
+    BitBuffer payload = to_bits(*schema.columns.front(), *schema.columns.front(), schema.index_locators); // columns not used on write
     const auto& data = payload.bytes();
 
     // compute pages needed (same approach as your ClusteredIndexNode)
@@ -194,6 +244,7 @@ std::vector<uint32_t> SecondaryIndexNode::save(const std::string& db_path,
         num_pages_needed = new_n;
     }
 
+    // own pages first, then fresh ones from the free-space map (only when saving)
     std::vector<uint32_t> used;
     used.push_back(*original_page_);
     for (uint32_t p : available_pages_) {
@@ -201,22 +252,12 @@ std::vector<uint32_t> SecondaryIndexNode::save(const std::string& db_path,
         used.push_back(p);
     }
 
-    if (used.size() < num_pages_needed) {
-        bool reupload = false;
-
-        available_pages avail = get_available_pages(db_path, *schema.available_pages_ref, page_size);
-        for (size_t i = 0; i < avail.available_pages_pointers.size() && used.size() < num_pages_needed; ++i) {
-            uint32_t p = avail.available_pages_pointers[i];
-            avail.available_pages_pointers.erase(avail.available_pages_pointers.begin() + i);
-            used.push_back(p);
-            reupload = true;
-        }
-        if (reupload) set_available_pages_db(db_path, avail, page_size);
+    auto pool = dbone::storage::BufferPool::shared(db_path, page_size);
+    if (do_save) {
+        auto& fsm = pool->free_space(*schema.available_pages_ref);
+        fsm.extend_chain(used, num_pages_needed); // grows in place when the next page is free
     }
 
-    size_t next_page = num_pages_in_file(db_path, page_size);
-    while (used.size() < num_pages_needed) used.push_back(static_cast<uint32_t>(next_page++));
-
     // header: U32 count_of_extra_pages, then the page ids (excluding root)
     BitBuffer header;
     header.putU32(static_cast<uint32_t>(used.size() - 1));
@@ -231,16 +272,7 @@ std::vector<uint32_t> SecondaryIndexNode::save(const std::string& db_path,
     }
 
     if (do_save) {
-        std::fstream out(db_path, std::ios::in | std::ios::out | std::ios::binary);
-        if (!out) throw std::runtime_error("SecondaryIndexNode::save: open for write failed");
-
-        for (size_t i = 0; i < used.size(); ++i) {
-            uint64_t off = uint64_t(used[i]) * page_size;
-            out.seekp(off, std::ios::beg);
-            out.write(reinterpret_cast<const char*>(&final_bytes[i * page_size]), page_size);
-            if (!out) throw std::runtime_error("SecondaryIndexNode::save: write page failed");
-        }
-        out.flush();
+        pool->write_pages(used, final_bytes.data()); // adjacent ids share one pwritev
     }
 
     return used;
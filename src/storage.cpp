@@ -1,15 +1,26 @@
 #include "dbone/storage.hpp"
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
+#include <new>
+#include <vector>
 
 // --------- 64-bit seeking wrappers ----------
 #if defined(_WIN32)
 #include <io.h>
 #include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 int dbone::storage::seek64(FILE *f, long long off, int whence) {
     return _fseeki64(f, off, whence);
 }
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <climits>
 int dbone::storage::seek64(FILE *f, long long off, int whence) {
     return fseeko(f, off, whence);
 }
@@ -32,3 +43,228 @@ bool dbone::storage::extend_file(FILE *f, uint64_t file_size, std::string *err)
     }
     return true;
 }
+
+// --------- AlignedBuffer ----------
+void dbone::storage::AlignedBuffer::resize(size_t size) {
+    data_.reset();
+    size_ = 0;
+    if (size == 0) return;
+    data_.reset(static_cast<uint8_t *>(::operator new(size, std::align_val_t(ALIGNMENT))));
+    std::memset(data_.get(), 0, size);
+    size_ = size;
+}
+
+void dbone::storage::AlignedBuffer::Free::operator()(uint8_t *p) const {
+    ::operator delete(p, std::align_val_t(ALIGNMENT));
+}
+
+// --------- PageFile ----------
+#if defined(_WIN32)
+// No pread/pwrite on the CRT: emulate with seek + read/write. Callers
+// (BufferPool) already serialize access to the handle.
+dbone::storage::PageFile::PageFile(const std::string &path, bool create) {
+    f_ = std::fopen(path.c_str(), "rb+");
+    if (!f_ && create) f_ = std::fopen(path.c_str(), "wb+");
+}
+
+dbone::storage::PageFile::~PageFile() {
+    if (f_) std::fclose(f_);
+}
+
+bool dbone::storage::PageFile::is_open() const {
+    return f_ != nullptr;
+}
+
+bool dbone::storage::PageFile::read_at(uint64_t offset, void *dst, size_t len) {
+    if (!f_) return false;
+    if (seek64(f_, static_cast<long long>(offset), SEEK_SET) != 0) return false;
+    return std::fread(dst, 1, len, f_) == len;
+}
+
+bool dbone::storage::PageFile::write_at(uint64_t offset, const void *src, size_t len) {
+    if (!write_at64(f_, offset, src, len)) return false;
+    return std::fflush(f_) == 0;
+}
+
+bool dbone::storage::PageFile::write_gather_at(uint64_t offset, std::span<const uint8_t *const> bufs, size_t len_each) {
+    if (!f_) return false;
+    if (seek64(f_, static_cast<long long>(offset), SEEK_SET) != 0) return false;
+    for (const uint8_t *buf : bufs) {
+        if (std::fwrite(buf, 1, len_each, f_) != len_each) return false;
+    }
+    return std::fflush(f_) == 0;
+}
+
+uint64_t dbone::storage::PageFile::size() const {
+    if (!f_) return 0;
+    struct _stat64 st;
+    if (_fstat64(_fileno(f_), &st) != 0) return 0;
+    return static_cast<uint64_t>(st.st_size);
+}
+
+bool dbone::storage::PageFile::sync() {
+    if (!f_) return false;
+    return std::fflush(f_) == 0 && _commit(_fileno(f_)) == 0;
+}
+
+bool dbone::storage::PageFile::truncate(uint64_t size) {
+    if (!f_) return false;
+    return std::fflush(f_) == 0 && _chsize_s(_fileno(f_), static_cast<long long>(size)) == 0;
+}
+
+bool dbone::storage::PageFile::reserve(uint64_t, uint64_t) {
+    return f_ != nullptr;
+}
+
+bool dbone::storage::PageFile::set_direct(bool on) {
+    // FILE_FLAG_NO_BUFFERING can only be chosen when the file is opened.
+    return !on;
+}
+
+dbone::storage::MappedRegion::~MappedRegion() {}
+
+std::shared_ptr<dbone::storage::MappedRegion> dbone::storage::PageFile::map(uint64_t) const {
+    return nullptr;
+}
+#else
+dbone::storage::PageFile::PageFile(const std::string &path, bool create) {
+    fd_ = ::open(path.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+}
+
+dbone::storage::PageFile::~PageFile() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool dbone::storage::PageFile::is_open() const {
+    return fd_ >= 0;
+}
+
+bool dbone::storage::PageFile::read_at(uint64_t offset, void *dst, size_t len) {
+    auto *out = static_cast<char *>(dst);
+    while (len > 0) {
+        ssize_t n = ::pread(fd_, out, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        out += n;
+        offset += static_cast<uint64_t>(n);
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool dbone::storage::PageFile::write_at(uint64_t offset, const void *src, size_t len) {
+    auto *in = static_cast<const char *>(src);
+    while (len > 0) {
+        ssize_t n = ::pwrite(fd_, in, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        in += n;
+        offset += static_cast<uint64_t>(n);
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool dbone::storage::PageFile::write_gather_at(uint64_t offset, std::span<const uint8_t *const> bufs, size_t len_each) {
+#ifdef IOV_MAX
+    const size_t max_iov = IOV_MAX;
+#else
+    const size_t max_iov = 1024;
+#endif
+    std::vector<iovec> iov;
+    iov.reserve(std::min(bufs.size(), max_iov));
+
+    size_t next = 0;
+    while (next < bufs.size()) {
+        iov.clear();
+        for (size_t i = next; i < bufs.size() && iov.size() < max_iov; i++) {
+            iov.push_back({const_cast<uint8_t *>(bufs[i]), len_each});
+        }
+        next += iov.size();
+
+        // Retry until the whole batch is out; a short write leaves us
+        // somewhere in the middle of one of the iovecs.
+        size_t first = 0;
+        while (first < iov.size()) {
+            ssize_t n = ::pwritev(fd_, &iov[first], static_cast<int>(iov.size() - first),
+                                  static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            offset += static_cast<uint64_t>(n);
+            size_t left = static_cast<size_t>(n);
+            while (first < iov.size() && left >= iov[first].iov_len) {
+                left -= iov[first].iov_len;
+                first++;
+            }
+            if (left > 0) {
+                iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + left;
+                iov[first].iov_len -= left;
+            }
+        }
+    }
+    return true;
+}
+
+uint64_t dbone::storage::PageFile::size() const {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) return 0;
+    return static_cast<uint64_t>(st.st_size);
+}
+
+bool dbone::storage::PageFile::sync() {
+#if defined(__APPLE__)
+    return ::fsync(fd_) == 0;
+#else
+    return ::fdatasync(fd_) == 0;
+#endif
+}
+
+bool dbone::storage::PageFile::truncate(uint64_t size) {
+    return ::ftruncate(fd_, static_cast<off_t>(size)) == 0;
+}
+
+bool dbone::storage::PageFile::reserve(uint64_t offset, uint64_t len) {
+#if defined(__linux__)
+    // KEEP_SIZE: size() stays the real end of the table, only the blocks
+    // behind it are allocated.
+    int rc;
+    do {
+        rc = ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(len));
+    } while (rc != 0 && errno == EINTR);
+    return rc == 0 || errno == EOPNOTSUPP;
+#elif defined(__APPLE__)
+    fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(len), 0};
+    if (::fcntl(fd_, F_PREALLOCATE, &store) == 0) return true;
+    store.fst_flags = F_ALLOCATEALL;
+    return ::fcntl(fd_, F_PREALLOCATE, &store) == 0;
+#else
+    (void)offset;
+    (void)len;
+    return fd_ >= 0;
+#endif
+}
+
+bool dbone::storage::PageFile::set_direct(bool on) {
+#if defined(__APPLE__)
+    return ::fcntl(fd_, F_NOCACHE, on ? 1 : 0) != -1;
+#elif defined(O_DIRECT)
+    int flags = ::fcntl(fd_, F_GETFL);
+    if (flags == -1) return false;
+    flags = on ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return ::fcntl(fd_, F_SETFL, flags) != -1;
+#else
+    return !on;
+#endif
+}
+
+dbone::storage::MappedRegion::~MappedRegion() {
+    if (data_) ::munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+std::shared_ptr<dbone::storage::MappedRegion> dbone::storage::PageFile::map(uint64_t length) const {
+    if (fd_ < 0 || length == 0) return nullptr;
+    void *p = ::mmap(nullptr, static_cast<size_t>(length), PROT_READ, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) return nullptr;
+    return std::make_shared<MappedRegion>(static_cast<const uint8_t *>(p), static_cast<size_t>(length));
+}
+#endif
@@ -0,0 +1,182 @@
+#pragma once
+#include "dbone/schema.hpp"
+#include "dbone/clustered_index_node.hpp"
+#include "dbone/secondary_index_node.hpp"
+#include "dbone/free_space_map.hpp"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// How the batch writer (insert_batch.cpp) and the remover (remove.cpp) reach
+// the nodes of the clustered tree and of a secondary index. Internal to the
+// library; not installed with the public headers.
+
+namespace dbone::detail
+{
+
+    // Where the rows of a batch end up, for index locators: the batch's
+    // keys in order, each with the page of the last node written that
+    // holds its row
+    struct Placement
+    {
+        std::vector<std::unique_ptr<DataType>> keys;
+        std::vector<uint32_t> pages;
+
+        size_t find(const DataType &key) const
+        {
+            auto at = std::lower_bound(keys.begin(), keys.end(), key, [](const std::unique_ptr<DataType> &k, const DataType &v)
+                                       { return *k < v; });
+            return at != keys.end() && **at == key ? static_cast<size_t>(at - keys.begin()) : keys.size();
+        }
+
+        void record(const std::vector<DataRow> &rows, size_t pk, uint32_t page)
+        {
+            for (const DataRow &row : rows)
+            {
+                size_t i = find(row.get(pk));
+                if (i < keys.size())
+                {
+                    pages[i] = page;
+                }
+            }
+        }
+
+        uint32_t page_of(const DataType &key) const
+        {
+            size_t i = find(key);
+            return i < keys.size() ? pages[i] : 0;
+        }
+    };
+
+    struct ClusteredTree
+    {
+        using Node = ClusteredIndexNode;
+        using Item = DataRow;
+
+        const std::string &db_path;
+        const TableSchema &schema;
+        uint32_t page_size;
+        size_t pk;
+        Placement *placement = nullptr;
+
+        Node load(uint32_t page) const { return Node::load(db_path, page, schema, page_size); }
+        std::vector<uint32_t> save(Node &node) const
+        {
+            std::vector<uint32_t> used = node.save(db_path, schema, page_size);
+            // B+tree inner nodes hold separators, not rows
+            if (placement && (!schema.bplus_tree || node.get_page_pointers()[0] == 0))
+            {
+                placement->record(node.get_items(), pk, *node.get_original_page());
+            }
+            return used;
+        }
+
+        static std::vector<Item> &items(Node &node) { return node.get_items(); }
+        static std::vector<uint32_t> &pointers(Node &node) { return node.get_page_pointers(); }
+        static uint32_t page(Node &node) { return *node.get_original_page(); }
+        static std::vector<uint32_t> spare_pages(Node &node) { return node.get_available_pages_index(); }
+
+        const DataType &key(const Item &row) const { return row.get(pk); }
+
+        // B+tree: rows only in linked leaves, short key-only separators above
+        bool leaf_rows() const { return schema.bplus_tree; }
+        Item separator(const Item &left, const Item &right) const { return DataRow::separator(left, right); }
+        static uint32_t prev_leaf(Node &node) { return node.prev_leaf(); }
+        static uint32_t next_leaf(Node &node) { return node.next_leaf(); }
+        static void link(Node &node, uint32_t prev, uint32_t next) { node.set_leaf_links(prev, next); }
+        void set_prev_leaf(uint32_t page, uint32_t prev) const
+        {
+            Node node = load(page);
+            node.set_leaf_links(prev, node.next_leaf());
+            node.save_links(db_path, schema, page_size);
+        }
+
+        // Duplicates are rejected before anything is written
+        void merge(Item &, Item &&row) const
+        {
+            throw std::runtime_error(
+                "Insert failed: primary key already exists (value = " +
+                key(row).default_value_str() + ")");
+        }
+    };
+
+    struct SecondaryTree
+    {
+        using Node = SecondaryIndexNode;
+        using Item = IndexEntry;
+
+        const std::string &db_path;
+        const TableSchema &schema;
+        uint32_t page_size;
+        const Column &indexed_col;
+        const Column &pk_col;
+
+        Node load(uint32_t page) const { return Node::load(db_path, page, schema, indexed_col, pk_col, page_size); }
+        std::vector<uint32_t> save(Node &node) const { return node.save(db_path, schema, page_size); }
+
+        static std::vector<Item> &items(Node &node) { return node.entries(); }
+        static std::vector<uint32_t> &pointers(Node &node) { return node.page_pointers(); }
+        static uint32_t page(Node &node) { return *node.original_page(); }
+        static std::vector<uint32_t> spare_pages(Node &node) { return node.get_available_pages_index(); }
+
+        const DataType &key(const Item &entry) const { return *entry.value; }
+
+        // Entries live at every level, so there are no leaf links
+        bool leaf_rows() const { return false; }
+        Item separator(const Item &, const Item &right) const { return right; }
+        static uint32_t prev_leaf(Node &) { return 0; }
+        static uint32_t next_leaf(Node &) { return 0; }
+        static void link(Node &, uint32_t, uint32_t) {}
+        void set_prev_leaf(uint32_t, uint32_t) const {}
+
+        // Both postings lists are in key order; a key's locator and
+        // included values move with it
+        void merge(Item &into, Item &&entry) const
+        {
+            std::vector<std::unique_ptr<DataType>> keys;
+            std::vector<uint32_t> locators;
+            std::vector<std::vector<std::unique_ptr<DataType>>> included;
+            keys.reserve(into.primary_keys.size() + entry.primary_keys.size());
+            size_t i = 0;
+            size_t j = 0;
+            while (i < into.primary_keys.size() || j < entry.primary_keys.size())
+            {
+                bool later = i == into.primary_keys.size() ||
+                             (j < entry.primary_keys.size() && *entry.primary_keys[j] < *into.primary_keys[i]);
+                Item &from = later ? entry : into;
+                size_t &k = later ? j : i;
+                if (schema.index_locators)
+                {
+                    locators.push_back(from.locator(k));
+                }
+                if (k < from.included.size())
+                {
+                    included.push_back(std::move(from.included[k]));
+                }
+                keys.push_back(std::move(from.primary_keys[k++]));
+            }
+            into.primary_keys = std::move(keys);
+            into.locators = std::move(locators);
+            into.included = std::move(included);
+        }
+    };
+
+    // Save node; overflow pages it no longer needs go back to the
+    // free-space map
+    template <typename Tree>
+    void write_node(const Tree &tree, storage::FreeSpaceMap &fsm, typename Tree::Node &node)
+    {
+        std::vector<uint32_t> spare = Tree::spare_pages(node);
+        std::vector<uint32_t> used = tree.save(node);
+        for (uint32_t page : spare)
+        {
+            if (std::find(used.begin(), used.end(), page) == used.end())
+            {
+                fsm.free_page(page);
+            }
+        }
+    }
+
+} // namespace dbone::detail
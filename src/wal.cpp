@@ -0,0 +1,245 @@
+#include "dbone/wal.hpp"
+#include <filesystem>
+#include <stdexcept>
+
+namespace dbone::storage
+{
+
+    namespace
+    {
+        // Record: [u32 kind][u64 lsn][u32 page_id][u32 len][len bytes][u32 checksum]
+        constexpr uint32_t KIND_PAGE = 1;
+        constexpr uint32_t KIND_COMMIT = 2;
+        constexpr size_t RECORD_HEADER = 4 + 8 + 4 + 4;
+        constexpr size_t RECORD_TRAILER = 4;
+
+        void put_u32(std::vector<uint8_t> &out, uint32_t v)
+        {
+            for (int i = 0; i < 4; i++)
+                out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+
+        void put_u64(std::vector<uint8_t> &out, uint64_t v)
+        {
+            for (int i = 0; i < 8; i++)
+                out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+
+        uint32_t get_u32(const uint8_t *p)
+        {
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                   (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        uint64_t get_u64(const uint8_t *p)
+        {
+            return static_cast<uint64_t>(get_u32(p)) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+        }
+
+        // FNV-1a; only has to catch torn or stale tails, not tampering.
+        uint32_t checksum(const uint8_t *p, size_t n)
+        {
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < n; i++)
+            {
+                h ^= p[i];
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        void put_record(std::vector<uint8_t> &out, uint32_t kind, uint64_t lsn, uint32_t page_id,
+                        const uint8_t *data, uint32_t len)
+        {
+            size_t start = out.size();
+            put_u32(out, kind);
+            put_u64(out, lsn);
+            put_u32(out, page_id);
+            put_u32(out, len);
+            out.insert(out.end(), data, data + len);
+            put_u32(out, checksum(out.data() + start, out.size() - start));
+        }
+    }
+
+    WriteAheadLog::WriteAheadLog(const std::string &path, uint32_t page_size)
+        : page_size_(page_size), file_(path, true)
+    {
+        if (!file_.is_open())
+        {
+            throw std::runtime_error("WriteAheadLog: failed to open " + path);
+        }
+        file_bytes_ = file_.size();
+    }
+
+    uint64_t WriteAheadLog::append(const std::vector<PageImage> &images)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        uint64_t lsn = next_lsn_++;
+        buffer_.reserve(buffer_.size() + images.size() * (RECORD_HEADER + page_size_ + RECORD_TRAILER) +
+                        RECORD_HEADER + RECORD_TRAILER);
+        for (const PageImage &image : images)
+        {
+            put_record(buffer_, KIND_PAGE, lsn, image.page_id, image.data, page_size_);
+        }
+        put_record(buffer_, KIND_COMMIT, lsn, 0, nullptr, 0);
+        appended_lsn_ = lsn;
+        stats_.commits++;
+        return lsn;
+    }
+
+    void WriteAheadLog::flush_to(uint64_t lsn)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        while (durable_lsn_ < lsn)
+        {
+            if (flushing_)
+            {
+                // Someone else is in fsync; our records ride on the next flush.
+                flushed_cv_.wait(lock);
+                continue;
+            }
+
+            flushing_ = true;
+            std::vector<uint8_t> batch;
+            batch.swap(buffer_);
+            uint64_t upto = appended_lsn_;
+            uint64_t offset = file_bytes_;
+            lock.unlock();
+
+            bool ok = file_.write_at(offset, batch.data(), batch.size()) && file_.sync();
+
+            lock.lock();
+            flushing_ = false;
+            if (!ok)
+            {
+                // Nothing in batch is durable: put it back ahead of what
+                // was appended since, so the next flush writes it again
+                // at the same offset before durable_lsn_ can pass it.
+                batch.insert(batch.end(), buffer_.begin(), buffer_.end());
+                buffer_.swap(batch);
+                flushed_cv_.notify_all();
+                throw std::runtime_error("WriteAheadLog: failed to flush log");
+            }
+            file_bytes_ = offset + batch.size();
+            durable_lsn_ = upto;
+            stats_.flushes++;
+            stats_.bytes += batch.size();
+            flushed_cv_.notify_all();
+        }
+    }
+
+    uint64_t WriteAheadLog::durable_lsn() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return durable_lsn_;
+    }
+
+    uint64_t WriteAheadLog::file_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return file_bytes_;
+    }
+
+    WriteAheadLog::Stats WriteAheadLog::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return stats_;
+    }
+
+    bool WriteAheadLog::reset()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (flushing_ || !buffer_.empty())
+            return false;
+        if (!file_.truncate(0) || !file_.sync())
+        {
+            throw std::runtime_error("WriteAheadLog: failed to truncate log");
+        }
+        file_bytes_ = 0;
+        return true;
+    }
+
+    std::string WriteAheadLog::path_for(const std::string &table_path)
+    {
+        return table_path + ".wal";
+    }
+
+    size_t WriteAheadLog::recover(const std::string &log_path, PageFile &data, uint32_t page_size)
+    {
+        std::error_code ec;
+        if (!std::filesystem::exists(log_path, ec) || std::filesystem::file_size(log_path, ec) == 0)
+            return 0;
+
+        PageFile log(log_path);
+        if (!log.is_open())
+        {
+            throw std::runtime_error("WriteAheadLog: failed to open " + log_path);
+        }
+
+        uint64_t size = log.size();
+        uint64_t off = 0;
+        size_t replayed = 0;
+
+        std::vector<uint8_t> record(RECORD_HEADER + page_size + RECORD_TRAILER);
+        std::vector<std::pair<uint32_t, std::vector<uint8_t>>> pending;
+        uint64_t pending_lsn = 0;
+
+        // Stop at the first record that is short, malformed or fails its
+        // checksum: everything after it is a torn write.
+        while (off + RECORD_HEADER + RECORD_TRAILER <= size)
+        {
+            if (!log.read_at(off, record.data(), RECORD_HEADER))
+                break;
+            uint32_t kind = get_u32(record.data());
+            uint64_t lsn = get_u64(record.data() + 4);
+            uint32_t page_id = get_u32(record.data() + 12);
+            uint32_t len = get_u32(record.data() + 16);
+
+            if ((kind == KIND_PAGE && len != page_size) || (kind == KIND_COMMIT && len != 0) ||
+                (kind != KIND_PAGE && kind != KIND_COMMIT))
+                break;
+            if (off + RECORD_HEADER + len + RECORD_TRAILER > size)
+                break;
+            if (!log.read_at(off + RECORD_HEADER, record.data() + RECORD_HEADER, len + RECORD_TRAILER))
+                break;
+            if (checksum(record.data(), RECORD_HEADER + len) != get_u32(record.data() + RECORD_HEADER + len))
+                break;
+            off += RECORD_HEADER + len + RECORD_TRAILER;
+
+            if (!pending.empty() && lsn != pending_lsn)
+            {
+                // Images without a commit record: transaction never committed.
+                pending.clear();
+            }
+            pending_lsn = lsn;
+
+            if (kind == KIND_PAGE)
+            {
+                pending.emplace_back(page_id, std::vector<uint8_t>(record.data() + RECORD_HEADER,
+                                                                   record.data() + RECORD_HEADER + len));
+                continue;
+            }
+
+            for (const auto &[pg, image] : pending)
+            {
+                if (!data.write_at(static_cast<uint64_t>(pg) * page_size, image.data(), page_size))
+                {
+                    throw std::runtime_error("WriteAheadLog: failed to replay page " + std::to_string(pg));
+                }
+            }
+            pending.clear();
+            replayed++;
+        }
+
+        if (replayed > 0 && !data.sync())
+        {
+            throw std::runtime_error("WriteAheadLog: failed to sync table after recovery");
+        }
+        if (!log.truncate(0) || !log.sync())
+        {
+            throw std::runtime_error("WriteAheadLog: failed to truncate " + log_path);
+        }
+        return replayed;
+    }
+
+} // namespace dbone::storage